@@ -0,0 +1,411 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include "source_factory.hpp"
+#include "latency_histogram.hpp"
+#include "precision_clock.hpp"
+#include "size_units.hpp"
+#include "kmsg_reader.hpp"
+
+// Which modules are loaded, kept current from kernel uevents: the kernel
+// broadcasts "add@/module/<name>" and "remove@/module/<name>" on the
+// NETLINK_KOBJECT_UEVENT socket, so a change costs one recv and nothing is
+// polled. Where the socket cannot be opened (some containers), /proc/modules
+// is re-read once a second and compared instead.
+class ModuleStateTracker {
+public:
+    ModuleStateTracker() {
+        fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (fd_ >= 0) {
+            sockaddr_nl addr{};
+            addr.nl_family = AF_NETLINK;
+            addr.nl_groups = 1;  // kernel uevents; group 2 is udev's rebroadcast
+            if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                close(fd_);
+                fd_ = -1;
+            }
+        }
+        // Subscribed first and read second, so no change falls in between
+        loaded_ = read_proc_modules();
+        last_scan_ = std::chrono::steady_clock::now();
+    }
+
+    ~ModuleStateTracker() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    ModuleStateTracker(const ModuleStateTracker&) = delete;
+    ModuleStateTracker& operator=(const ModuleStateTracker&) = delete;
+
+    // Socket to wait on with poll(), -1 in /proc/modules mode
+    int fd() const { return fd_; }
+    const char* mechanism() const { return fd_ >= 0 ? "uevent" : "/proc/modules"; }
+
+    // Applies pending changes; true if any module came or went
+    bool update() {
+        if (fd_ < 0) {
+            const auto now = std::chrono::steady_clock::now();
+            if (now - last_scan_ < std::chrono::seconds(1)) return false;
+            last_scan_ = now;
+            auto current = read_proc_modules();
+            if (current == loaded_) return false;
+            loaded_ = std::move(current);
+            return true;
+        }
+
+        bool changed = false;
+        char msg[8192];
+        ssize_t n;
+        while ((n = recv(fd_, msg, sizeof(msg) - 1, 0)) > 0) {
+            msg[n] = '\0';
+            // Header "action@devpath", then NUL-separated KEY=value pairs
+            const std::string header(msg);
+            const auto at = header.find('@');
+            if (at == std::string::npos) continue;
+            const std::string action = header.substr(0, at);
+            const std::string devpath = header.substr(at + 1);
+            if (devpath.rfind("/module/", 0) != 0) continue;
+            const std::string name = devpath.substr(8);
+            if (action == "add") {
+                changed |= loaded_.insert(name).second;
+            } else if (action == "remove") {
+                changed |= loaded_.erase(name) > 0;
+            }
+        }
+        return changed;
+    }
+
+    bool loaded(const std::string& name) const {
+        std::string sysfs = name;
+        for (auto& c : sysfs) {
+            if (c == '-') c = '_';
+        }
+        return loaded_.count(sysfs) > 0;
+    }
+
+private:
+    int fd_ = -1;
+    std::set<std::string> loaded_;
+    std::chrono::steady_clock::time_point last_scan_;
+
+    static std::set<std::string> read_proc_modules() {
+        std::set<std::string> names;
+        std::ifstream f("/proc/modules");
+        std::string line;
+        while (std::getline(f, line)) {
+            names.insert(line.substr(0, line.find(' ')));
+        }
+        return names;
+    }
+};
+
+// Background RNG sampler: every tick it times a short burst of reads and
+// files them as one slot of a ring covering the last WINDOW ticks. A burst
+// of 8 small reads per 100 ms keeps its duty cycle in the per-mille range,
+// so it observes the machine without loading it.
+class RngSampler {
+public:
+    static constexpr size_t WINDOW = 10;  // ticks in the rolling view
+
+    struct Snapshot {
+        LatencyHistogram histogram;  // ns, all reads in the window
+        double throughput = 0;       // MB/s while reading
+        double duty = 0;             // fraction of wall time spent reading
+        std::deque<double> p99_history;  // µs, one entry per tick, oldest first
+        std::string error;               // why sampling stopped, empty while it runs
+    };
+
+    RngSampler(const std::string& source, size_t chunk_size, size_t reads_per_tick,
+               std::chrono::milliseconds tick)
+        : source_(make_entropy_source(source)),
+          CHUNK_SIZE(chunk_size),
+          READS_PER_TICK(reads_per_tick),
+          TICK(tick),
+          buffer_(chunk_size) {}
+
+    ~RngSampler() {
+        stop();
+    }
+
+    void start() {
+        running_ = true;
+        thread_ = std::thread([this] { loop(); });
+    }
+
+    void stop() {
+        running_ = false;
+        if (thread_.joinable()) thread_.join();
+    }
+
+    Snapshot snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Snapshot snap;
+        uint64_t bytes = 0, busy_ns = 0;
+        for (const auto& slot : slots_) {
+            snap.histogram.merge(slot.histogram);
+            bytes += slot.bytes;
+            busy_ns += slot.busy_ns;
+        }
+        snap.throughput = busy_ns ? bytes / (busy_ns / 1e9) / 1e6 : 0;
+        const double window_ns = static_cast<double>(slots_.size()) * TICK.count() * 1e6;
+        snap.duty = window_ns > 0 ? busy_ns / window_ns : 0;
+        snap.p99_history = p99_history_;
+        snap.error = error_;
+        return snap;
+    }
+
+private:
+    struct Slot {
+        LatencyHistogram histogram;
+        uint64_t bytes = 0;
+        uint64_t busy_ns = 0;
+    };
+
+    static constexpr size_t HISTORY = 60;
+
+    std::unique_ptr<EntropySource> source_;
+    const size_t CHUNK_SIZE;
+    const size_t READS_PER_TICK;
+    const std::chrono::milliseconds TICK;
+    std::vector<char> buffer_;
+    const PrecisionClock& clock_ = PrecisionClock::instance();
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::deque<Slot> slots_;
+    std::deque<double> p99_history_;
+    std::string error_;
+
+    // A read that fails (a hook returning an error, a source the kernel
+    // lacks) ends sampling; the dashboard shows the reason and keeps running
+    void loop() {
+        try {
+            sample();
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = e.what();
+        }
+    }
+
+    void sample() {
+        auto next = std::chrono::steady_clock::now();
+        while (running_) {
+            Slot slot;
+            for (size_t i = 0; i < READS_PER_TICK; ++i) {
+                const uint64_t start = clock_.start();
+                source_->fill(buffer_.data(), CHUNK_SIZE);
+                const uint64_t ns = clock_.elapsed_ns(start, clock_.stop());
+                slot.histogram.record(ns);
+                slot.busy_ns += ns;
+                slot.bytes += CHUNK_SIZE;
+            }
+            const double p99 = slot.histogram.value_at_percentile(99) / 1e3;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                slots_.push_back(std::move(slot));
+                if (slots_.size() > WINDOW) slots_.pop_front();
+                p99_history_.push_back(p99);
+                if (p99_history_.size() > HISTORY) p99_history_.pop_front();
+            }
+            next += TICK;
+            std::this_thread::sleep_until(next);
+        }
+    }
+};
+
+// Full-screen view refreshed at 10 Hz until 'q': module state, the
+// sampler's rolling throughput and percentiles, the hook modules'
+// counters where their sysfs parameters or debugfs files are readable, and
+// the latest kernel messages that mention one of the modules.
+class Dashboard {
+public:
+    Dashboard(std::vector<std::string> modules, std::string source, size_t chunk_size)
+        : modules_(std::move(modules)),
+          source_name_(std::move(source)),
+          CHUNK_SIZE(chunk_size),
+          sampler_(source_name_, chunk_size, 8, std::chrono::milliseconds(100)) {
+        try {
+            kmsg_ = std::make_unique<KmsgReader>();
+            kmsg_->seek_to_end();
+        } catch (const std::exception&) {
+            // Without CAP_SYSLOG the section just stays empty
+        }
+    }
+
+    void run() {
+        RawTerminal terminal;
+        sampler_.start();
+
+        auto next_frame = std::chrono::steady_clock::now();
+        bool quit = false;
+        int input = STDIN_FILENO;  // -1 once stdin is closed; poll() skips it
+        while (!quit) {
+            pollfd fds[2] = {{input, POLLIN, 0}, {tracker_.fd(), POLLIN, 0}};
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_frame - std::chrono::steady_clock::now());
+            poll(fds, tracker_.fd() >= 0 ? 2 : 1, std::max<int>(0, static_cast<int>(wait.count())));
+
+            // At EOF stdin stays readable forever; polling it further would
+            // spin, so from then on only a signal ends the dashboard
+            if (fds[0].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) {
+                char c = 0;
+                const ssize_t n = read(STDIN_FILENO, &c, 1);
+                if (n == 1 && (c == 'q' || c == 'Q')) quit = true;
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR) || (fds[0].revents & POLLNVAL)) {
+                    input = -1;
+                }
+            }
+            tracker_.update();
+
+            if (std::chrono::steady_clock::now() >= next_frame) {
+                draw();
+                next_frame += FRAME;
+            }
+        }
+        sampler_.stop();
+    }
+
+private:
+    static constexpr std::chrono::milliseconds FRAME{100};
+
+    const std::vector<std::string> modules_;
+    const std::string source_name_;
+    const size_t CHUNK_SIZE;
+    ModuleStateTracker tracker_;
+    RngSampler sampler_;
+    std::unique_ptr<KmsgReader> kmsg_;
+    std::deque<KmsgRecord> messages_;  // newest last
+
+    static constexpr size_t MESSAGE_LINES = 5;
+
+    // Non-canonical, no echo while the dashboard runs; restored on exit
+    struct RawTerminal {
+        termios saved{};
+        bool active = false;
+        RawTerminal() {
+            if (tcgetattr(STDIN_FILENO, &saved) != 0) return;
+            termios raw = saved;
+            raw.c_lflag &= ~(ICANON | ECHO);
+            raw.c_cc[VMIN] = 0;
+            raw.c_cc[VTIME] = 0;
+            active = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+        }
+        ~RawTerminal() {
+            if (active) tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+        }
+    };
+
+    static std::string read_first_line(const std::string& path) {
+        std::ifstream f(path);
+        std::string line;
+        std::getline(f, line);
+        return line;
+    }
+
+    // p99 per tick as one character each, scaled to the window's maximum
+    static std::string sparkline(const std::deque<double>& values) {
+        static const char levels[] = " .:-=+*#%@";
+        double max = 0;
+        for (double v : values) max = std::max(max, v);
+        std::string line;
+        for (double v : values) {
+            line += levels[max > 0 ? static_cast<size_t>(v / max * 9 + 0.5) : 0];
+        }
+        return line;
+    }
+
+    void draw() {
+        std::ostringstream out;
+        out << "\033[H\033[J"
+            << "=== RNG Dashboard: " << source_name_ << ", " << format_size(CHUNK_SIZE)
+            << " reads (q to quit) ===\n\n"
+            << "Modules (" << tracker_.mechanism() << "):\n";
+        for (const auto& name : modules_) {
+            out << "  " << std::left << std::setw(22) << name << std::right
+                << (tracker_.loaded(name) ? "LOADED" : "NOT LOADED") << "\n";
+        }
+
+        const auto snap = sampler_.snapshot();
+        const auto& h = snap.histogram;
+        out << "\nLast " << RngSampler::WINDOW / 10.0 << " s (" << h.count() << " reads, sampler duty "
+            << std::fixed << std::setprecision(2) << snap.duty * 100 << " %):\n"
+            << "  " << std::setprecision(1) << snap.throughput << " MB/s   µs:";
+        for (const auto& [label, percentile] : report_percentiles()) {
+            out << "  " << label << " " << h.value_at_percentile(percentile) / 1e3;
+        }
+        out << "  max " << h.max() / 1e3 << "\n" << std::defaultfloat
+            << "  p99 history [" << sparkline(snap.p99_history) << "]\n";
+        if (!snap.error.empty()) out << "  Sampling stopped: " << snap.error << "\n";
+
+        draw_hook_counters(out);
+        draw_kernel_messages(out);
+        std::cout << out.str() << std::flush;
+    }
+
+    bool mentions_module(const std::string& message) const {
+        for (const auto& name : modules_) {
+            if (message.find(name) != std::string::npos) return true;
+        }
+        return message.find("kprobe") != std::string::npos || message.find("ftrace") != std::string::npos;
+    }
+
+    void draw_kernel_messages(std::ostringstream& out) {
+        if (!kmsg_) return;
+        kmsg_->read_available([this](KmsgRecord&& record) {
+            if (!mentions_module(record.message)) return;
+            messages_.push_back(std::move(record));
+            if (messages_.size() > MESSAGE_LINES) messages_.pop_front();
+        });
+        out << "\nKernel messages:\n";
+        for (const auto& record : messages_) {
+            out << "  " << record.format() << "\n";
+        }
+    }
+
+    void draw_hook_counters(std::ostringstream& out) const {
+        out << "\nHook counters:\n";
+        bool any = false;
+        for (const auto& name : modules_) {
+            if (!tracker_.loaded(name)) continue;
+            const std::string params = "/sys/module/" + name + "/parameters/";
+            const std::string applied = read_first_line(params + "delays_applied");
+            if (applied.empty()) continue;
+            out << "  " << name << ": delays " << applied << ", delay total "
+                << read_first_line(params + "delay_total_ns") << " ns, mode "
+                << read_first_line(params + "delay_mode") << "\n";
+            any = true;
+        }
+        // debugfs needs root; the kprobe module's directory is kprobe_demo
+        for (const std::string dir : {"kprobe_demo", "ftrace_hook_demo"}) {
+            std::ifstream stats("/sys/kernel/debug/" + dir + "/stats");
+            std::string line;
+            bool header = true;
+            while (std::getline(stats, line) && line.rfind("latency_ns_upper", 0) != 0) {
+                if (header) out << "  debugfs " << dir << ":\n";
+                header = false;
+                out << "    " << line << "\n";
+                any = true;
+            }
+        }
+        if (!any) out << "  none readable (no hook loaded, or debugfs needs root)\n";
+    }
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdio>
+#include <unistd.h>
+#include "thread_scaling.hpp"
+#include "benchmark_options.hpp"
+#include "kernel_module.hpp"
+#include "result_store.hpp"
+#include "size_units.hpp"
+
+// Unattended runs of every hook configuration against every backend, size
+// and thread count. The spec is a line-oriented text file:
+//
+//   # comment
+//   module none                                    baseline, no hook loaded
+//   module kprobe_override
+//   module ../../ftrace_hook/ftrace_hook_demo.ko hook_mode=fastfill delay_mode=off
+//   sources getrandom,urandom
+//   sizes 4K,64K,1M
+//   threads 1,4
+//   repetitions 3
+//   iterations 1000                                reads per thread and cell
+//   output matrix.results
+//
+// Each module line is one configuration; its module is loaded with those
+// parameters, every cell of it is measured and it is unloaded again before
+// the next configuration. A bare name is loaded from the module directory,
+// whose prebuilt binaries take no parameters, so configurations with
+// parameters name the freshly built .ko by path; a parameter the module
+// does not have fails the load rather than mislabel the cells. After each cell the
+// whole dataset is rewritten (to a temp file, then renamed), so a run that
+// is interrupted resumes by skipping the cells already in the output.
+struct ModuleConfig {
+    std::string module;  // name or path of the .ko, "none" for the baseline
+    std::string params;  // insmod-style, space separated
+
+    // Name used in the dataset, without spaces or path: kprobe_override or
+    // ftrace_hook_demo[hook_mode=fastfill,delay_mode=off]
+    std::string label() const {
+        const std::string name = module == "none" ? module : module_name_from_path(module);
+        if (params.empty()) return name;
+        std::string joined = params;
+        for (auto& c : joined) {
+            if (c == ' ') c = ',';
+        }
+        return name + "[" + joined + "]";
+    }
+};
+
+struct MatrixSpec {
+    std::vector<ModuleConfig> configs;
+    std::vector<std::string> sources;
+    std::vector<size_t> sizes;
+    std::vector<size_t> threads = {1};
+    size_t repetitions = 1;
+    size_t iterations = 1000;
+    std::string output = "matrix.results";
+
+    size_t cells() const {
+        return configs.size() * sources.size() * sizes.size() * threads.size() * repetitions;
+    }
+};
+
+inline MatrixSpec parse_matrix_spec(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Failed to open experiment spec " + path);
+    }
+
+    MatrixSpec spec;
+    std::string line;
+    for (size_t number = 1; std::getline(in, line); ++number) {
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key) || key[0] == '#') continue;
+        std::string rest;
+        std::getline(fields >> std::ws, rest);
+        const std::string where = path + ":" + std::to_string(number) + ": ";
+
+        if (key == "module") {
+            ModuleConfig config;
+            std::istringstream words(rest);
+            words >> config.module;
+            std::string param;
+            while (words >> param) {
+                if (!config.params.empty()) config.params += ' ';
+                config.params += param;
+            }
+            if (config.module.empty()) throw std::invalid_argument(where + "module needs a name");
+            spec.configs.push_back(config);
+        } else if (key == "sources") {
+            spec.sources = rest == "all" ? available_entropy_sources() : split_list(rest);
+        } else if (key == "sizes") {
+            spec.sizes.clear();
+            for (const auto& size : split_list(rest)) spec.sizes.push_back(parse_size(size));
+        } else if (key == "threads") {
+            spec.threads.clear();
+            for (const auto& count : split_list(rest)) spec.threads.push_back(std::stoul(count));
+        } else if (key == "repetitions") {
+            spec.repetitions = std::stoul(rest);
+        } else if (key == "iterations") {
+            spec.iterations = std::stoul(rest);
+        } else if (key == "output") {
+            spec.output = rest;
+        } else {
+            throw std::invalid_argument(where + "unknown key '" + key + "'");
+        }
+    }
+
+    if (spec.configs.empty()) spec.configs.push_back({"none", ""});
+    if (spec.sources.empty() || spec.sizes.empty()) {
+        throw std::invalid_argument(path + ": sources and sizes are required");
+    }
+    for (size_t t : spec.threads) {
+        if (t == 0) throw std::invalid_argument(path + ": thread counts start at 1");
+    }
+    if (spec.repetitions == 0 || spec.iterations == 0) {
+        throw std::invalid_argument(path + ": repetitions and iterations must be positive");
+    }
+    for (const auto& source : spec.sources) {
+        make_entropy_source(source);  // unknown names fail now, not hours in
+    }
+    return spec;
+}
+
+class ExperimentMatrix {
+public:
+    ExperimentMatrix(MatrixSpec spec, std::string module_dir)
+        : spec_(std::move(spec)), module_dir_(std::move(module_dir)) {}
+
+    void run() {
+        resume();
+        const size_t total = spec_.cells();
+        std::cout << "Experiment matrix: " << total << " cells, " << done_ << " already in " << spec_.output << "\n";
+
+        for (const auto& config : spec_.configs) {
+            if (config_complete(config)) continue;
+
+            unload_spec_modules();
+            if (config.module != "none") {
+                load_kernel_module(module_path(module_dir_, config.module), config.params);
+                std::cout << "Loaded " << config.label() << "\n";
+            }
+            try {
+                run_config(config, total);
+            } catch (...) {
+                unload_spec_modules();
+                throw;
+            }
+        }
+        unload_spec_modules();
+        std::cout << "Experiment matrix complete: " << spec_.output << "\n";
+    }
+
+private:
+    MatrixSpec spec_;
+    const std::string module_dir_;
+    ResultSet results_;
+    size_t done_ = 0;
+
+    // Picks up the cells of an interrupted run from the output file
+    void resume() {
+        const EnvironmentInfo env = EnvironmentInfo::current();
+        if (access(spec_.output.c_str(), F_OK) != 0) {
+            results_.env = env;
+            return;
+        }
+        results_ = load_results(spec_.output);
+        if (results_.env.kernel != env.kernel) {
+            throw std::runtime_error(spec_.output + " was recorded on kernel " + results_.env.kernel +
+                                     ", this is " + env.kernel);
+        }
+        done_ = completed_cells();
+    }
+
+    bool has_cell(const RunRecord& cell) const {
+        for (const auto& run : results_.runs) {
+            if (run.same_cell(cell)) return true;
+        }
+        return false;
+    }
+
+    // Cells of this spec already in the output; runs of other specs sharing
+    // the file are kept but not counted
+    size_t completed_cells() const {
+        size_t count = 0;
+        for (const auto& config : spec_.configs) {
+            for (size_t rep = 0; rep < spec_.repetitions; ++rep) {
+                for (const auto& source : spec_.sources) {
+                    for (size_t size : spec_.sizes) {
+                        for (size_t threads : spec_.threads) {
+                            count += has_cell(make_cell(config, source, size, threads, rep));
+                        }
+                    }
+                }
+            }
+        }
+        return count;
+    }
+
+    bool config_complete(const ModuleConfig& config) const {
+        for (size_t rep = 0; rep < spec_.repetitions; ++rep) {
+            for (const auto& source : spec_.sources) {
+                for (size_t size : spec_.sizes) {
+                    for (size_t threads : spec_.threads) {
+                        if (!has_cell(make_cell(config, source, size, threads, rep))) return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    static RunRecord make_cell(const ModuleConfig& config, const std::string& source, size_t size,
+                               size_t threads, size_t rep) {
+        RunRecord cell;
+        cell.source = source;
+        cell.chunk_size = size;
+        cell.config = config.label();
+        cell.threads = threads;
+        cell.repetition = rep;
+        return cell;
+    }
+
+    // Leaves no module of the spec loaded, whatever an earlier run left behind
+    void unload_spec_modules() const {
+        for (const auto& config : spec_.configs) {
+            const std::string name = module_name_from_path(config.module);
+            if (config.module != "none" && is_kernel_module_loaded(name)) {
+                unload_kernel_module(name);
+            }
+        }
+    }
+
+    // Repetitions outermost, so slow drift spreads over all cells of a
+    // configuration instead of piling onto the last ones
+    void run_config(const ModuleConfig& config, size_t total) {
+        for (size_t rep = 0; rep < spec_.repetitions; ++rep) {
+            for (const auto& source : spec_.sources) {
+                for (size_t size : spec_.sizes) {
+                    for (size_t threads : spec_.threads) {
+                        RunRecord cell = make_cell(config, source, size, threads, rep);
+                        if (has_cell(cell)) continue;
+
+                        ThreadScalingBenchmark bench(source, spec_.iterations, size, threads);
+                        const auto step = bench.measure(threads);
+                        cell.histogram = step.histogram;
+                        cell.wall_us = step.wall_us;
+                        cell.aggregate_throughput = step.aggregate_throughput;
+                        results_.runs.push_back(std::move(cell));
+                        checkpoint();
+
+                        ++done_;
+                        const auto& h = results_.runs.back().histogram;
+                        std::cout << "[" << done_ << "/" << total << "] " << config.label() << " " << source
+                                  << " " << format_size(size) << " x" << threads << " rep " << rep + 1
+                                  << ": p50 " << h.value_at_percentile(50) / 1e3 << " µs, p99 "
+                                  << h.value_at_percentile(99) / 1e3 << " µs, " << step.aggregate_throughput
+                                  << " MB/s\n";
+                    }
+                }
+            }
+        }
+    }
+
+    // A crash mid-write must not lose the cells already measured
+    void checkpoint() const {
+        const std::string temp = spec_.output + ".tmp";
+        save_results(temp, results_);
+        if (std::rename(temp.c_str(), spec_.output.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace " + spec_.output + ": " + std::strerror(errno));
+        }
+    }
+};
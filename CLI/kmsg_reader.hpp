@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdexcept>
+#include <functional>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Reader for /dev/kmsg, the kernel log as structured records. Each read()
+// returns exactly one record:
+//
+//   <prio>,<seq>,<timestamp us>,<flags>;<message>\n
+//    KEY=value\n                                  (optional continuation)
+//
+// The timestamp is microseconds from printk's local_clock(), the per-CPU
+// scheduler clock, as dmesg shows it. That is not CLOCK_MONOTONIC: it is
+// not NTP-slewed, may stop or not stop in suspend depending on the
+// platform, and can differ slightly between CPUs, so use it to order kernel
+// messages, not to match them to clock_gettime() stamps of the benchmark.
+struct KmsgRecord {
+    int level = 0;          // 0 (emerg) .. 7 (debug)
+    int facility = 0;
+    uint64_t sequence = 0;
+    uint64_t timestamp_us = 0;
+    std::string message;
+
+    // "[  123.456789] message", like dmesg
+    std::string format() const {
+        char stamp[32];
+        snprintf(stamp, sizeof(stamp), "[%5llu.%06llu] ", static_cast<unsigned long long>(timestamp_us / 1000000),
+                 static_cast<unsigned long long>(timestamp_us % 1000000));
+        return stamp + message;
+    }
+};
+
+class KmsgReader {
+public:
+    // Empty filter matches everything, otherwise a substring of the message
+    // such as "[kprobe]" or "ftrace_hook_demo"
+    explicit KmsgReader(std::string filter = "") : filter_(std::move(filter)) {
+        fd_ = open("/dev/kmsg", O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd_ < 0) {
+            throw std::runtime_error(std::string("Failed to open /dev/kmsg: ") + std::strerror(errno) +
+                                     (errno == EPERM ? " (needs CAP_SYSLOG when dmesg_restrict is set)" : ""));
+        }
+    }
+
+    ~KmsgReader() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    KmsgReader(const KmsgReader&) = delete;
+    KmsgReader& operator=(const KmsgReader&) = delete;
+
+    int fd() const { return fd_; }
+
+    // Skips everything already logged; later reads see only new records
+    void seek_to_end() {
+        lseek(fd_, 0, SEEK_END);
+    }
+
+    // The last `count` matching records currently in the buffer. Reads from
+    // the oldest record not cleared by dmesg -C but keeps only `count` of
+    // them, and leaves the reader at the end for follow mode.
+    std::vector<KmsgRecord> tail(size_t count) {
+        lseek(fd_, 0, SEEK_DATA);
+        std::deque<KmsgRecord> last;
+        read_available([&](KmsgRecord&& record) {
+            last.push_back(std::move(record));
+            if (last.size() > count) last.pop_front();
+        });
+        return {std::make_move_iterator(last.begin()), std::make_move_iterator(last.end())};
+    }
+
+    // Hands every new matching record to `sink` without blocking; returns
+    // how many there were
+    size_t read_available(const std::function<void(KmsgRecord&&)>& sink) {
+        char buf[8192];
+        size_t delivered = 0;
+        for (;;) {
+            const ssize_t n = read(fd_, buf, sizeof(buf) - 1);
+            if (n < 0) {
+                if (errno == EPIPE) continue;  // overwritten before we got to it
+                if (errno == EINTR) continue;
+                break;                         // EAGAIN: caught up
+            }
+            if (n == 0) break;
+            buf[n] = '\0';
+            KmsgRecord record;
+            if (!parse(buf, record) || !matches(record)) continue;
+            sink(std::move(record));
+            ++delivered;
+        }
+        return delivered;
+    }
+
+private:
+    int fd_ = -1;
+    const std::string filter_;
+
+    bool matches(const KmsgRecord& record) const {
+        return filter_.empty() || record.message.find(filter_) != std::string::npos;
+    }
+
+    static bool parse(const char* text, KmsgRecord& record) {
+        const char* semicolon = std::strchr(text, ';');
+        if (!semicolon) return false;
+
+        char* end = nullptr;
+        const unsigned long prio = std::strtoul(text, &end, 10);
+        if (*end != ',') return false;
+        record.sequence = std::strtoull(end + 1, &end, 10);
+        if (*end != ',') return false;
+        record.timestamp_us = std::strtoull(end + 1, &end, 10);
+        record.level = static_cast<int>(prio & 7);
+        record.facility = static_cast<int>(prio >> 3);
+
+        // The message runs to the first newline; continuation lines follow
+        const char* message = semicolon + 1;
+        const char* newline = std::strchr(message, '\n');
+        record.message.assign(message, newline ? newline - message : std::strlen(message));
+        return true;
+    }
+};
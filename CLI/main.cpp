@@ -5,19 +5,22 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <libgen.h>
+#include <errno.h>
+#include "experiment_matrix.hpp"
+#include "dashboard.hpp"
+#include "kmsg_reader.hpp"
 
-#define MODULE_DIR "/sys/module/"
 #define CUSTOM_MOD_DIR "../modules/"
 #define MAX_MODNAME_LEN 64
+#define MAX_MODPATH_LEN 256
+#define MAX_PARAMS_LEN 512
 
 void clear_screen() {
     printf("\033[H\033[J");
 }
 
 int is_module_loaded(const char *modname) {
-    char path[256];
-    snprintf(path, sizeof(path), "%s%s", MODULE_DIR, modname);
-    return access(path, F_OK) == 0;
+    return is_kernel_module_loaded(module_name_from_path(modname));
 }
 
 void get_custom_modules(char modules[][MAX_MODNAME_LEN], int *count) {
@@ -62,57 +65,227 @@ void print_menu(const char custom_mods[][MAX_MODNAME_LEN], int mod_count) {
     printf("  %2d. Unload module\n", mod_count+2);
     printf("  %2d. Refresh list\n", mod_count+3);
     printf("  %2d. View dmesg\n", mod_count+4);
-    printf("  %2d. Exit\n", mod_count+5);
+    printf("  %2d. Load several modules\n", mod_count+5);
+    printf("  %2d. Unload several modules\n", mod_count+6);
+    printf("  %2d. Live dashboard\n", mod_count+7);
+    printf("  %2d. Exit\n", mod_count+8);
     printf("Select option: ");
 }
 
-void load_module(const char *modname) {
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "sudo insmod %s%s.ko", CUSTOM_MOD_DIR, modname);
-    
-    printf("Loading module %s...\n", modname);
-    if (system(cmd))
-    {
-        printf("Failed to load module. Check dmesg for details.\n");
-    } else {
-        printf("Module loaded successfully!\n");
+// Loads ../modules/<modname>.ko, or the .ko at modname if it is a path,
+// passing params as on an insmod command line ("delay_us=200
+// delay_mode=uniform"), and reports the outcome.
+// Returns 0 or a negative errno. See kernel_module.hpp.
+int load_module(const char *modname, const char *params) {
+    try {
+        load_kernel_module(module_path(CUSTOM_MOD_DIR, modname), params ? params : "");
+    } catch (const KernelModuleError& e) {
+        printf("Failed to load %s: %s\n", modname, e.what());
+        return -e.error();
     }
-    sleep(1);
+    printf("Module %s loaded successfully!\n", modname);
+    return 0;
 }
 
-void unload_module(const char *modname) {
-    if (!is_module_loaded(modname)) {
-        printf("Module %s is not loaded!\n", modname);
-        sleep(1);
-        return;
+// Removes a module and reports the outcome. Returns 0 or a negative errno;
+// -EWOULDBLOCK/-EBUSY mean the module is still in use.
+int unload_module(const char *modname) {
+    try {
+        unload_kernel_module(module_name_from_path(modname));
+    } catch (const KernelModuleError& e) {
+        printf("Failed to unload %s: %s\n", modname, e.what());
+        return -e.error();
     }
-    
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "sudo rmmod %s", modname);
-    
-    printf("Unloading module %s...\n", modname);
-    if (system(cmd)) {
-        printf("Failed to unload module. Is it in use?\n");
-    } else {
-        printf("Module unloaded successfully!\n");
+    printf("Module %s unloaded successfully!\n", modname);
+    return 0;
+}
+
+// Batch variants: every module is attempted; returns the number of failures
+int load_modules(const char *const *modnames, const char *const *params, int count) {
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (load_module(modnames[i], params ? params[i] : NULL)) failed++;
+    }
+    return failed;
+}
+
+// Unloads in reverse order, so modules loaded together come out cleanly
+int unload_modules(const char *const *modnames, int count) {
+    int failed = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        if (!is_module_loaded(modnames[i])) {
+            printf("Module %s is not loaded!\n", modnames[i]);
+            continue;
+        }
+        if (unload_module(modnames[i])) failed++;
+    }
+    return failed;
+}
+
+void wait_for_enter() {
+    printf("\nPress Enter to continue...");
+    getchar(); getchar();
+}
+
+// Reads a line of space separated module names into names; returns how many
+int read_module_names(char names[][MAX_MODNAME_LEN], int max) {
+    char line[1024];
+    int count = 0;
+    while (getchar() != '\n');  // rest of the menu choice
+    if (!fgets(line, sizeof(line), stdin)) return 0;
+    for (char *tok = strtok(line, " \t\n"); tok && count < max; tok = strtok(NULL, " \t\n")) {
+        snprintf(names[count++], MAX_MODNAME_LEN, "%s", tok);
+    }
+    return count;
+}
+
+// Prints new kernel messages as they arrive until Enter is pressed. With
+// stdin at EOF (a script, </dev/null) it follows until a signal instead.
+void follow_kmsg(KmsgReader& kmsg) {
+    printf("--- following, press Enter to stop ---\n");
+    fflush(stdout);
+    int input = STDIN_FILENO;  // -1 once stdin is closed; poll() skips it
+    for (;;) {
+        struct pollfd fds[2] = {{kmsg.fd(), POLLIN, 0}, {input, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        if (fds[0].revents & POLLIN) {
+            kmsg.read_available([](KmsgRecord&& r) { printf("%s\n", r.format().c_str()); });
+            fflush(stdout);
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) {
+            char buf[256];
+            const ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n > 0 && memchr(buf, '\n', n)) break;
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR) || (fds[1].revents & POLLNVAL)) {
+                input = -1;
+            }
+        }
+    }
+}
+
+// Last 20 kernel messages matching filter (empty for all), then optionally
+// follows new ones
+int show_kmsg(const char *filter, int follow) {
+    try {
+        KmsgReader kmsg(filter);
+        for (const auto& record : kmsg.tail(20)) {
+            printf("%s\n", record.format().c_str());
+        }
+        if (follow) follow_kmsg(kmsg);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
     }
-    sleep(1);
+    return 0;
 }
 
 void view_dmesg() {
     clear_screen();
+    while (getchar() != '\n');  // rest of the menu choice
+    printf("Filter by module name or prefix (empty for all): ");
+    char filter[128];
+    if (!fgets(filter, sizeof(filter), stdin)) filter[0] = '\0';
+    filter[strcspn(filter, "\n")] = '\0';
+
     printf("=== Last kernel messages ===\n");
-    system("sudo dmesg | tail -20");
+    if (show_kmsg(filter, 0) == 0) {
+        printf("\nEnter f to follow new messages, or just Enter to continue: ");
+        char answer[16];
+        if (fgets(answer, sizeof(answer), stdin) && (answer[0] == 'f' || answer[0] == 'F')) {
+            show_kmsg(filter, 1);
+        }
+        return;
+    }
     printf("\nPress Enter to continue...");
-    getchar(); getchar();
+    getchar();
 }
 
 
 
-int main() {
+// Runs an experiment spec, see experiment_matrix.hpp
+int run_matrix(const char *spec_path) {
+    try {
+        ExperimentMatrix matrix(parse_matrix_spec(spec_path), CUSTOM_MOD_DIR);
+        matrix.run();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+// Live view of the modules in ../modules/ and of RNG latency, see dashboard.hpp
+int run_dashboard(const char *source, const char *size) {
+    char custom_mods[100][MAX_MODNAME_LEN];
+    int mod_count = 0;
+    get_custom_modules(custom_mods, &mod_count);
+    try {
+        Dashboard dashboard(std::vector<std::string>(custom_mods, custom_mods + mod_count),
+                            source, parse_size(size));
+        dashboard.run();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+// Non-interactive use:
+//   CLI load <module> [<module>...]    (module=params form: name:"a=1 b=2";
+//                                       a module with a '/' is a path to the .ko)
+//   CLI unload <module> [<module>...]
+//   CLI matrix <spec>
+//   CLI dashboard [source] [read size]     (default getrandom 4K)
+//   CLI dmesg [filter] [-f]                (-f follows new messages)
+int run_command(int argc, char **argv) {
+    if (strcmp(argv[1], "dmesg") == 0) {
+        const char *filter = "";
+        int follow = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-f") == 0) follow = 1;
+            else filter = argv[i];
+        }
+        return show_kmsg(filter, follow);
+    }
+    if (strcmp(argv[1], "matrix") == 0 && argc == 3) return run_matrix(argv[2]);
+    if (strcmp(argv[1], "dashboard") == 0) {
+        return run_dashboard(argc > 2 ? argv[2] : "getrandom", argc > 3 ? argv[3] : "4K");
+    }
+
+    const int count = argc - 2;
+    if (count <= 0) {
+        fprintf(stderr, "Usage: %s load|unload <module>[:params] ...\n"
+                        "       %s matrix <spec>\n"
+                        "       %s dashboard [source] [read size]\n"
+                        "       %s dmesg [filter] [-f]\n", argv[0], argv[0], argv[0], argv[0]);
+        return 2;
+    }
+
+    char names[100][MAX_MODPATH_LEN];
+    const char *name_ptrs[100];
+    const char *params[100];
+    for (int i = 0; i < count && i < 100; i++) {
+        const char *arg = argv[i + 2];
+        const char *colon = strchr(arg, ':');
+        const size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+        snprintf(names[i], MAX_MODPATH_LEN, "%.*s", (int)len, arg);
+        name_ptrs[i] = names[i];
+        params[i] = colon ? colon + 1 : "";
+    }
+
+    const int n = count < 100 ? count : 100;
+    if (strcmp(argv[1], "load") == 0) return load_modules(name_ptrs, params, n) ? 1 : 0;
+    if (strcmp(argv[1], "unload") == 0) return unload_modules(name_ptrs, n) ? 1 : 0;
+    fprintf(stderr, "Unknown command: %s\n", argv[1]);
+    return 2;
+}
+
+int main(int argc, char **argv) {
     char custom_mods[100][MAX_MODNAME_LEN];
     int mod_count = 0;
     int choice;
+
+    if (argc > 1) return run_command(argc, argv);
     
     // Replace $(uname -r) with actual kernel version
     char resolved_path[256];
@@ -134,9 +307,11 @@ int main() {
                 scanf(" %c", &confirm);
                 if (confirm == 'y' || confirm == 'Y') {
                     unload_module(custom_mods[choice-1]);
+                    wait_for_enter();
                 }
             } else {
-                load_module(custom_mods[choice-1]);
+                load_module(custom_mods[choice-1], NULL);
+                wait_for_enter();
             }
         } 
         else if (choice == mod_count + 1) {
@@ -144,14 +319,26 @@ int main() {
             printf("Enter module name (without .ko): ");
             char modname[MAX_MODNAME_LEN];
             scanf("%63s", modname);
-            load_module(modname);
+            while (getchar() != '\n');
+            printf("Enter module parameters (empty for none): ");
+            char params[MAX_PARAMS_LEN];
+            if (!fgets(params, sizeof(params), stdin)) params[0] = '\0';
+            params[strcspn(params, "\n")] = '\0';
+            load_module(modname, params);
+            printf("\nPress Enter to continue...");
+            getchar();
         }
         else if (choice == mod_count + 2) {
             // Unload module
             printf("Enter module name: ");
             char modname[MAX_MODNAME_LEN];
             scanf("%63s", modname);
-            unload_module(modname);
+            if (!is_module_loaded(modname)) {
+                printf("Module %s is not loaded!\n", modname);
+            } else {
+                unload_module(modname);
+            }
+            wait_for_enter();
         }
         else if (choice == mod_count + 3) {
             // Refresh - will happen automatically
@@ -160,7 +347,25 @@ int main() {
         else if (choice == mod_count + 4) {
             view_dmesg();
         }
-        else if (choice == mod_count + 5) {
+        else if (choice == mod_count + 5 || choice == mod_count + 6) {
+            printf("Enter module names separated by spaces: ");
+            char names[100][MAX_MODNAME_LEN];
+            const char *name_ptrs[100];
+            int count = read_module_names(names, 100);
+            for (int i = 0; i < count; i++) name_ptrs[i] = names[i];
+            if (choice == mod_count + 5) {
+                load_modules(name_ptrs, NULL, count);
+            } else {
+                unload_modules(name_ptrs, count);
+            }
+            printf("\nPress Enter to continue...");
+            getchar();
+        }
+        else if (choice == mod_count + 7) {
+            while (getchar() != '\n');
+            run_dashboard("getrandom", "4K");
+        }
+        else if (choice == mod_count + 8) {
             break; // Exit
         }
     }
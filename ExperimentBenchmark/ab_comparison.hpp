@@ -0,0 +1,165 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <stdexcept>
+#include "source_factory.hpp"
+#include "latency_histogram.hpp"
+#include "ab_statistics.hpp"
+#include "graph_plotter.hpp"
+#include "precision_clock.hpp"
+
+// One side of an A/B run: which source to read and what to switch on/off
+// around each of its blocks (e.g. load and unload a hook module).
+struct ABArm {
+    std::string label;
+    std::string source;
+    std::function<void()> enter;
+    std::function<void()> leave;
+};
+
+// Runs baseline and treatment in interleaved ABBA blocks so slow drift
+// (thermal, frequency, background load) hits both arms equally, then
+// reports the difference with bootstrap confidence intervals and a
+// Mann-Whitney U test on the per-call latencies.
+class ABComparison {
+public:
+    // Bootstrap cost grows with sample count; beyond this a fixed random
+    // subsample of each arm is resampled instead.
+    static constexpr size_t MAX_BOOTSTRAP_SAMPLES = 20000;
+
+    ABComparison(ABArm baseline, ABArm treatment, size_t block_pairs, size_t block_iterations,
+                 size_t chunk_size, const SourceSettings& settings = {})
+        : BLOCK_PAIRS(block_pairs),
+          BLOCK_ITERATIONS(block_iterations),
+          CHUNK_SIZE(chunk_size),
+          settings_(settings),
+          buffer_(chunk_size) {
+        arms_[0].arm = std::move(baseline);
+        arms_[1].arm = std::move(treatment);
+    }
+
+    void use_clock(const PrecisionClock& clock) { clock_ = &clock; }
+
+    void run() {
+        std::cout << "Starting A/B comparison: " << arms_[0].arm.label << " vs " << arms_[1].arm.label
+                  << ", " << BLOCK_PAIRS * 2 << " blocks of " << BLOCK_ITERATIONS << " reads in ABBA order\n";
+
+        for (size_t block = 0; block < BLOCK_PAIRS * 2; ++block) {
+            // A B B A A B B A ...
+            const size_t arm = ((block + 1) / 2) % 2;
+            run_block(arms_[arm]);
+            const auto& state = arms_[arm];
+            std::cout << "Block " << block + 1 << "/" << BLOCK_PAIRS * 2 << " (" << state.arm.label << "): "
+                      << state.block_latency.back() << " µs avg, "
+                      << state.block_throughput.back() << " MB/s\n";
+        }
+
+        analyze_results();
+    }
+
+    void add_block_graphs(GraphPlotter& plotter) const {
+        for (const auto& state : arms_) {
+            plotter.addGraph(state.arm.label, state.block_points);
+        }
+    }
+
+private:
+    struct ArmState {
+        ABArm arm;
+        std::vector<double> latencies;        // µs, every call
+        std::vector<double> block_latency;    // µs, mean per block
+        std::vector<double> block_throughput; // MB/s per block
+        std::vector<std::pair<double, double>> block_points;
+        LatencyHistogram histogram;           // ns
+    };
+
+    const size_t BLOCK_PAIRS;
+    const size_t BLOCK_ITERATIONS;
+    const size_t CHUNK_SIZE;
+    const SourceSettings settings_;
+    std::vector<char> buffer_;
+    const PrecisionClock* clock_ = &PrecisionClock::instance();
+    ArmState arms_[2];
+    size_t blocks_run_ = 0;
+
+    void run_block(ArmState& state) {
+        if (state.arm.enter) state.arm.enter();
+        try {
+            auto source = make_entropy_source(state.arm.source, settings_);
+            source->fill(buffer_.data(), CHUNK_SIZE);  // untimed: first call after a switch
+
+            double total_us = 0;
+            for (size_t i = 0; i < BLOCK_ITERATIONS; ++i) {
+                const uint64_t start = clock_->start();
+                source->fill(buffer_.data(), CHUNK_SIZE);
+                const uint64_t end = clock_->stop();
+                const uint64_t ns = clock_->elapsed_ns(start, end);
+                state.histogram.record(ns);
+                state.latencies.push_back(ns / 1e3);
+                total_us += ns / 1e3;
+            }
+
+            const double avg = total_us / BLOCK_ITERATIONS;
+            state.block_latency.push_back(avg);
+            state.block_throughput.push_back(CHUNK_SIZE / (avg / 1e6) / 1e6);
+            state.block_points.emplace_back(++blocks_run_, avg);
+        } catch (...) {
+            if (state.arm.leave) state.arm.leave();
+            throw;
+        }
+        if (state.arm.leave) state.arm.leave();
+    }
+
+    static std::vector<double> bootstrap_subsample(const std::vector<double>& v) {
+        if (v.size() <= MAX_BOOTSTRAP_SAMPLES) return v;
+        std::vector<double> sub;
+        sub.reserve(MAX_BOOTSTRAP_SAMPLES);
+        std::sample(v.begin(), v.end(), std::back_inserter(sub), MAX_BOOTSTRAP_SAMPLES, std::mt19937_64(42));
+        return sub;
+    }
+
+    static void print_row(const std::string& metric, double a, double b, const ConfidenceInterval& ci) {
+        std::cout << std::left << std::setw(24) << metric << std::right
+                  << std::setw(14) << a << std::setw(14) << b
+                  << std::setw(14) << ci.estimate
+                  << "   [" << ci.lower << ", " << ci.upper << "]"
+                  << std::setw(10) << (a != 0 ? 100.0 * ci.estimate / a : 0) << " %\n";
+    }
+
+    void analyze_results() const {
+        const auto& base = arms_[0];
+        const auto& treat = arms_[1];
+        const auto base_sub = bootstrap_subsample(base.latencies);
+        const auto treat_sub = bootstrap_subsample(treat.latencies);
+
+        std::cout << "\n=== A/B Results: " << base.arm.label << " (A) vs " << treat.arm.label << " (B) ===\n"
+                  << std::left << std::setw(24) << "Metric" << std::right
+                  << std::setw(14) << "A" << std::setw(14) << "B"
+                  << std::setw(14) << "B - A" << "   95% bootstrap CI" << std::setw(12) << "change" << "\n";
+
+        print_row("Median latency (µs)", sample_median(base.latencies), sample_median(treat.latencies),
+                  bootstrap_difference(base_sub, treat_sub, sample_median));
+        print_row("Mean latency (µs)", sample_mean(base.latencies), sample_mean(treat.latencies),
+                  bootstrap_difference(base_sub, treat_sub, sample_mean));
+        print_row("Throughput (MB/s)", sample_mean(base.block_throughput), sample_mean(treat.block_throughput),
+                  bootstrap_difference(base.block_throughput, treat.block_throughput, sample_mean));
+
+        for (const auto& [label, percentile] : report_percentiles()) {
+            std::cout << std::left << std::setw(24) << (label + " latency (µs)") << std::right
+                      << std::setw(14) << base.histogram.value_at_percentile(percentile) / 1e3
+                      << std::setw(14) << treat.histogram.value_at_percentile(percentile) / 1e3 << "\n";
+        }
+
+        const auto mw = mann_whitney_u(base.latencies, treat.latencies);
+        std::cout << "\nMann-Whitney U: U=" << mw.u << ", z=" << mw.z << ", p=" << mw.p_value << "\n"
+                  << "P(B call slower than A call): " << 1.0 - mw.effect << "\n"
+                  << (mw.p_value < 0.05 ? "Latency distributions differ significantly (p < 0.05)\n"
+                                        : "No significant latency difference (p >= 0.05)\n");
+    }
+};
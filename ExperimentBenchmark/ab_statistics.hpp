@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+
+// Two-sample statistics for A/B runs. Everything here works on plain
+// sample vectors so it can be reused for latency and throughput alike.
+
+struct ConfidenceInterval {
+    double estimate = 0;
+    double lower = 0;
+    double upper = 0;
+};
+
+struct MannWhitneyResult {
+    double u = 0;          // U statistic of the first sample
+    double z = 0;          // normal approximation, tie-corrected
+    double p_value = 1;    // two-sided
+    double effect = 0.5;   // P(a > b) + 0.5 P(a == b), the common-language effect size
+};
+
+inline double sample_mean(const std::vector<double>& v) {
+    return v.empty() ? 0.0 : std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+}
+
+// Median without reordering the caller's data
+inline double sample_median(std::vector<double> v) {
+    if (v.empty()) return 0.0;
+    const size_t mid = v.size() / 2;
+    std::nth_element(v.begin(), v.begin() + mid, v.end());
+    double m = v[mid];
+    if (v.size() % 2 == 0) {
+        m = (m + *std::max_element(v.begin(), v.begin() + mid)) / 2;
+    }
+    return m;
+}
+
+// Percentile bootstrap of statistic(b) - statistic(a): both samples are
+// resampled independently with replacement `reps` times.
+inline ConfidenceInterval bootstrap_difference(const std::vector<double>& a, const std::vector<double>& b,
+                                               const std::function<double(const std::vector<double>&)>& statistic,
+                                               size_t reps = 2000, double confidence = 0.95,
+                                               unsigned seed = 12345) {
+    ConfidenceInterval ci;
+    ci.estimate = statistic(b) - statistic(a);
+    if (a.empty() || b.empty() || reps == 0) {
+        ci.lower = ci.upper = ci.estimate;
+        return ci;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<size_t> pick_a(0, a.size() - 1);
+    std::uniform_int_distribution<size_t> pick_b(0, b.size() - 1);
+    std::vector<double> ra(a.size()), rb(b.size());
+    std::vector<double> diffs;
+    diffs.reserve(reps);
+
+    for (size_t r = 0; r < reps; ++r) {
+        for (auto& x : ra) x = a[pick_a(rng)];
+        for (auto& x : rb) x = b[pick_b(rng)];
+        diffs.push_back(statistic(rb) - statistic(ra));
+    }
+
+    std::sort(diffs.begin(), diffs.end());
+    const double alpha = (1.0 - confidence) / 2;
+    ci.lower = diffs[static_cast<size_t>(alpha * (reps - 1))];
+    ci.upper = diffs[static_cast<size_t>((1.0 - alpha) * (reps - 1))];
+    return ci;
+}
+
+// Mann-Whitney U test with average ranks for ties and the normal
+// approximation, which is accurate for the sample sizes benchmarks produce.
+inline MannWhitneyResult mann_whitney_u(const std::vector<double>& a, const std::vector<double>& b) {
+    MannWhitneyResult result;
+    const double n1 = a.size(), n2 = b.size();
+    if (a.empty() || b.empty()) return result;
+
+    std::vector<std::pair<double, int>> all;
+    all.reserve(a.size() + b.size());
+    for (double x : a) all.emplace_back(x, 0);
+    for (double x : b) all.emplace_back(x, 1);
+    std::sort(all.begin(), all.end());
+
+    double rank_sum_a = 0;
+    double tie_term = 0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) ++j;
+        const double avg_rank = (i + 1 + j) / 2.0;  // ranks are 1-based
+        for (size_t k = i; k < j; ++k) {
+            if (all[k].second == 0) rank_sum_a += avg_rank;
+        }
+        const double t = static_cast<double>(j - i);
+        tie_term += t * t * t - t;
+        i = j;
+    }
+
+    result.u = rank_sum_a - n1 * (n1 + 1) / 2;
+    result.effect = result.u / (n1 * n2);
+
+    const double n = n1 + n2;
+    const double mean_u = n1 * n2 / 2;
+    const double var_u = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)));
+    if (var_u <= 0) return result;
+
+    // Continuity correction towards the mean
+    const double diff = result.u - mean_u;
+    result.z = std::fabs(diff) <= 0.5 ? 0.0 : (diff - std::copysign(0.5, diff)) / std::sqrt(var_u);
+    result.p_value = std::erfc(std::fabs(result.z) / std::sqrt(2.0));
+    return result;
+}
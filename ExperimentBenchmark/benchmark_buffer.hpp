@@ -0,0 +1,258 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+// Where fill() writes to. The default is the original value-initialised
+// std::vector; the other strategies take first-touch faults and TLB misses
+// out of (or deliberately into) the measured calls:
+//
+//   vector    std::vector<char>, zeroed at construction
+//   lazy      fresh anonymous mapping, never touched: first calls pay the faults
+//   prefault  MAP_POPULATE and a write to every page before the run
+//   hugepage  MAP_HUGETLB, else a 2 MB aligned mapping with MADV_HUGEPAGE (THP)
+//   mlock     prefaulted and locked in RAM
+//   aligned   aligned_alloc at --buffer-align bytes, prefaulted
+//   rotating  prefaulted buffers cycled per call, together > 2x the LLC, so
+//             every call writes to memory that is not in cache; they are
+//             slices of one mapping, a cache line apart at least
+enum class BufferStrategy { Vector, Lazy, Prefault, Hugepage, Mlock, Aligned, Rotating };
+
+inline const std::vector<std::string>& buffer_strategy_names() {
+    static const std::vector<std::string> names = {
+        "vector", "lazy", "prefault", "hugepage", "mlock", "aligned", "rotating",
+    };
+    return names;
+}
+
+inline BufferStrategy parse_buffer_strategy(const std::string& name) {
+    const auto& names = buffer_strategy_names();
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it == names.end()) {
+        throw std::invalid_argument("Unknown buffer strategy: " + name);
+    }
+    return static_cast<BufferStrategy>(it - names.begin());
+}
+
+// Last-level cache size from sysfs, 32 MB if it cannot be read
+inline size_t last_level_cache_size() {
+    size_t best = 0;
+    for (int index = 0; index < 8; ++index) {
+        std::ifstream f("/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/size");
+        std::string text;
+        if (!(f >> text)) continue;
+        size_t value = std::stoul(text);
+        if (text.back() == 'K') value <<= 10;
+        else if (text.back() == 'M') value <<= 20;
+        best = std::max(best, value);
+    }
+    return best ? best : 32 << 20;
+}
+
+struct PageFaults {
+    uint64_t minor = 0;
+    uint64_t major = 0;
+
+    static PageFaults current() {
+        rusage usage;
+        getrusage(RUSAGE_THREAD, &usage);
+        return {static_cast<uint64_t>(usage.ru_minflt), static_cast<uint64_t>(usage.ru_majflt)};
+    }
+
+    PageFaults operator-(const PageFaults& o) const { return {minor - o.minor, major - o.major}; }
+    uint64_t total() const { return minor + major; }
+};
+
+// Average cost of one first-touch (minor) fault on this machine, measured by
+// writing to every page of a fresh 4 MB mapping.
+inline double first_touch_fault_us() {
+    constexpr size_t LENGTH = 4 << 20;
+    void* p = mmap(nullptr, LENGTH, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return 0;
+    madvise(p, LENGTH, MADV_NOHUGEPAGE);  // one fault per 4K page, as in the lazy case
+
+    const auto before = PageFaults::current();
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < LENGTH; offset += static_cast<size_t>(getpagesize())) {
+        static_cast<volatile char*>(p)[offset] = 0;
+    }
+    const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    const uint64_t faults = (PageFaults::current() - before).total();
+    munmap(p, LENGTH);
+    return faults ? us / faults : 0;
+}
+
+class BenchmarkBuffer {
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+    BenchmarkBuffer(BufferStrategy strategy, size_t size, size_t alignment = 4096)
+        : strategy_(strategy), size_(size) {
+        const auto before = PageFaults::current();
+        const auto start = std::chrono::steady_clock::now();
+        mappings_.reserve(1);  // so recording a mapping cannot throw and leak it
+
+        switch (strategy) {
+            case BufferStrategy::Vector:
+                vector_.resize(size);
+                base_ = vector_.data();
+                break;
+            case BufferStrategy::Lazy:
+                base_ = map(size, 0);
+                break;
+            case BufferStrategy::Prefault:
+                base_ = map(size, MAP_POPULATE);
+                touch(base_);
+                break;
+            case BufferStrategy::Hugepage:
+                base_ = map_huge(size);
+                touch(base_);
+                break;
+            case BufferStrategy::Mlock:
+                base_ = map(size, MAP_POPULATE);
+                if (mlock(base_, size) != 0) {
+                    throw std::runtime_error("mlock of " + std::to_string(size) + " bytes failed: " + std::strerror(errno) +
+                                             " (check ulimit -l)");
+                }
+                touch(base_);
+                break;
+            case BufferStrategy::Aligned: {
+                if (alignment == 0 || (alignment & (alignment - 1))) {
+                    throw std::invalid_argument("Buffer alignment must be a power of two");
+                }
+                alignment = std::max(alignment, sizeof(void*));
+                void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+                if (!p) throw std::runtime_error("aligned_alloc failed");
+                aligned_.reset(static_cast<char*>(p));
+                base_ = aligned_.get();
+                touch(aligned_.get());
+                break;
+            }
+            case BufferStrategy::Rotating: {
+                // Slots overlap nothing but the line-rounding padding, and
+                // small chunks cost one mapping instead of one per slot
+                const size_t stride = (std::max<size_t>(size, 1) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+                const size_t count = std::max<size_t>(2, (2 * last_level_cache_size() + stride - 1) / stride);
+                const size_t length = stride * (count - 1) + size;
+                base_ = map(length, MAP_POPULATE);
+                touch(base_, length);
+                stride_ = stride;
+                slot_count_ = count;
+                break;
+            }
+        }
+
+        setup_us_ = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        setup_faults_ = PageFaults::current() - before;
+    }
+
+    BenchmarkBuffer(const BenchmarkBuffer&) = delete;
+    BenchmarkBuffer& operator=(const BenchmarkBuffer&) = delete;
+
+    // Buffer for the next call; only the rotating strategy changes it
+    char* next() {
+        char* p = base_ + cursor_ * stride_;
+        if (++cursor_ == slot_count_) cursor_ = 0;
+        return p;
+    }
+
+    size_t size() const { return size_; }
+    size_t slots() const { return slot_count_; }
+
+    // Faults and time spent preparing the buffer(s) before the run
+    const PageFaults& setup_faults() const { return setup_faults_; }
+    double setup_us() const { return setup_us_; }
+
+    std::string describe() const {
+        std::string text = buffer_strategy_names()[static_cast<size_t>(strategy_)];
+        if (!backing_.empty()) text += " (" + backing_ + ")";
+        if (slot_count_ > 1) text += ", " + std::to_string(slot_count_) + " buffers";
+        return text;
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    // Owners of what the constructor allocated, so that anything set up
+    // before a later step throws is released with the members
+    struct Mapping {
+        void* addr;
+        size_t length;
+
+        Mapping(void* a, size_t l) : addr(a), length(l) {}
+        Mapping(Mapping&& o) noexcept : addr(std::exchange(o.addr, nullptr)), length(o.length) {}
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        Mapping& operator=(Mapping&&) = delete;
+        ~Mapping() {
+            if (addr) munmap(addr, length);
+        }
+    };
+
+    struct FreeDeleter {
+        void operator()(char* p) const { std::free(p); }
+    };
+
+    BufferStrategy strategy_;
+    size_t size_;
+    std::vector<char> vector_;
+    std::unique_ptr<char, FreeDeleter> aligned_;
+    std::vector<Mapping> mappings_;
+    char* base_ = nullptr;      // first slot
+    size_t stride_ = 0;         // slot i is base_ + i * stride_
+    size_t slot_count_ = 1;
+    size_t cursor_ = 0;
+    std::string backing_;
+    PageFaults setup_faults_;
+    double setup_us_ = 0;
+
+    char* map(size_t length, int extra_flags) {
+        void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::runtime_error(std::string("mmap failed: ") + std::strerror(errno));
+        }
+        mappings_.emplace_back(p, length);
+        return static_cast<char*>(p);
+    }
+
+    // Explicit hugetlbfs pages need a reserved pool (vm.nr_hugepages); without
+    // one fall back to transparent huge pages on a 2 MB aligned region.
+    char* map_huge(size_t length) {
+        const size_t rounded = (length + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void* p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (p != MAP_FAILED) {
+            mappings_.emplace_back(p, rounded);
+            backing_ = "hugetlb";
+            return static_cast<char*>(p);
+        }
+
+        char* raw = map(rounded + HUGE_PAGE_SIZE, 0);
+        char* aligned = reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(raw) + HUGE_PAGE_SIZE - 1) & ~(uintptr_t(HUGE_PAGE_SIZE) - 1));
+        backing_ = madvise(aligned, rounded, MADV_HUGEPAGE) == 0 ? "THP" : "THP unavailable, 4K pages";
+        return aligned;
+    }
+
+    void touch(char* p) const { touch(p, size_); }
+
+    static void touch(char* p, size_t length) {
+        const size_t page = static_cast<size_t>(getpagesize());
+        for (size_t offset = 0; offset < length; offset += page) {
+            static_cast<volatile char*>(p)[offset] = 0;
+        }
+    }
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include "source_factory.hpp"
+#include "size_units.hpp"
+#include "random_benchmark.hpp"
+#include "benchmark_buffer.hpp"
+#include "load_generator.hpp"
+#include "graph_plotter.hpp"
+
+struct BenchmarkOptions {
+    size_t num_experiments = 1000;
+    size_t chunk_size = 8 * 1024 * 1024; // 8 MB
+    std::vector<std::string> sources = {"random"};
+    SourceSettings source_settings;
+    size_t threads = 0;  // 0 = single-threaded run, N = scale 1..N reader threads
+    bool sweep = false;
+    size_t sweep_min = 1;
+    size_t sweep_max = 64 * 1024 * 1024; // 64 MB
+    size_t sweep_steps = 1;              // sizes per doubling
+    double sweep_min_time = 0.2;         // seconds measured per size
+    std::vector<StressSpec> load;  // interference mode: stressors per level
+    size_t load_levels = 3;
+    std::string ab_module;         // A/B: treatment = this .ko loaded
+    std::string ab_module_params;
+    std::string ab_source;         // A/B: treatment = this source instead of the first --source
+    size_t ab_blocks = 10;         // block pairs
+    std::string save_path;         // write results here
+    std::string baseline_path;     // compare this run against a stored baseline
+    std::string compare_baseline;  // --compare BASE CAND: offline check of two files
+    std::string compare_candidate;
+    double max_regression = 5.0;   // % worse p99/throughput that fails the check
+    StoppingRule stopping;
+    bool perf = false;             // perf_event_open counters around every call
+    bool tsc = true;               // time calls with the TSC when it is invariant
+    bool quality = false;          // randomness checks on every filled buffer
+    std::string buffer_strategy;   // empty = plain std::vector, no fault accounting
+    size_t buffer_align = 4096;    // for the aligned strategy
+    bool histogram_only = false;  // record into the histogram, keep no per-call samples
+    bool plot = true;
+    std::string downsample = "minmax";  // how long series are reduced for plotting
+    size_t plot_points = 10000;          // per graph
+    bool live_plot = false;              // plot the last plot_points samples while running
+    bool list_sources = false;
+    bool help = false;
+};
+
+inline std::vector<std::string> split_list(const std::string& text, char delimiter = ',') {
+    std::vector<std::string> items;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, delimiter)) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+inline void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  -n, --iterations N     Number of reads per source (default 1000)\n"
+              << "  -c, --chunk-size SIZE  Bytes per read, K/M/G suffixes allowed (default 8M)\n"
+              << "  -s, --source LIST      Comma-separated entropy sources or 'all' (default random)\n"
+              << "      --uring-depth N    io_uring reads kept in flight (default 32)\n"
+              << "      --uring-batch N    io_uring submissions per syscall (default 8)\n"
+              << "      --chacha-reseed SIZE      chacha-pool: reseed after SIZE bytes (default 1M)\n"
+              << "      --chacha-reseed-interval SEC  chacha-pool: reseed after SEC seconds, 0 = never (default 5)\n"
+              << "  -t, --threads N        Scaling mode: run 1..N pinned reader threads\n"
+              << "      --sweep            Sweep log-spaced chunk sizes instead of a fixed size\n"
+              << "      --sweep-min SIZE   Smallest swept size (default 1)\n"
+              << "      --sweep-max SIZE   Largest swept size (default 64M)\n"
+              << "      --sweep-steps N    Sizes per doubling (default 1)\n"
+              << "      --min-time SEC     Minimum measured time per swept size (default 0.2)\n"
+              << "      --load SPEC        Interference mode: e.g. cpu:1,mem:1,io:1,syscall:1,rng:1 or all\n"
+              << "      --load-levels N    Measure at 0..N times the --load threads (default 3)\n"
+              << "      --ab-module PATH   A/B mode: compare with and without this module loaded\n"
+              << "      --ab-module-params STR  Parameters passed to the A/B module\n"
+              << "      --ab-source NAME   A/B mode: compare the first --source against NAME\n"
+              << "      --ab-blocks N      A/B block pairs, -n reads per block (default 10)\n"
+              << "      --adaptive         Discard warmup, stop once the mean converges (-n is the maximum)\n"
+              << "      --target-ci PCT    Relative 95% CI half-width to stop at (default 1)\n"
+              << "      --time-budget SEC  Stop a source after SEC seconds\n"
+              << "      --min-iterations N Steady-state iterations before stopping (default 50)\n"
+              << "      --save FILE        Write results with environment metadata to FILE\n"
+              << "      --baseline FILE    Check this run against FILE, exit 2 on regression,\n"
+              << "                         3 if no run matched or baseline runs are missing\n"
+              << "      --compare BASE NEW Check two results files without running, same exit status\n"
+              << "      --max-regression PCT  Allowed p99/throughput regression (default 5)\n"
+              << "      --clock NAME       Per-call timer: tsc (default, if invariant) or monotonic\n"
+              << "      --perf             Collect cycles/instructions/cache-misses/ctx-switches/faults/migrations\n"
+              << "      --quality          Check every buffer (monobit, runs, chi-square, serial correlation)\n"
+              << "      --buffer STRATEGY  vector, lazy, prefault, hugepage, mlock, aligned or rotating;\n"
+              << "                         also reports page faults taken inside the reads\n"
+              << "      --buffer-align N   Alignment of the aligned strategy (default 4096)\n"
+              << "      --histogram-only   Keep only the latency histogram (no per-iteration samples)\n"
+              << "      --list-sources     Print the sources available on this machine\n"
+              << "      --no-plot          Skip the gnuplot window\n"
+              << "      --downsample MODE  Reduce long series for plotting: minmax (default), lttb or none\n"
+              << "      --plot-points N    Points per graph after downsampling (default 10000)\n"
+              << "      --live-plot        Plot the latest samples while the benchmark runs\n"
+              << "  -h, --help             Show this message\n";
+}
+
+inline BenchmarkOptions parse_options(int argc, char** argv) {
+    BenchmarkOptions opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-n" || arg == "--iterations") {
+            opts.num_experiments = std::stoul(value());
+        } else if (arg == "-c" || arg == "--chunk-size") {
+            opts.chunk_size = parse_size(value());
+        } else if (arg == "-s" || arg == "--source") {
+            std::string list = value();
+            opts.sources = list == "all" ? available_entropy_sources() : split_list(list);
+        } else if (arg == "--uring-depth") {
+            opts.source_settings.uring_depth = std::stoul(value());
+        } else if (arg == "--uring-batch") {
+            opts.source_settings.uring_batch = std::stoul(value());
+        } else if (arg == "--chacha-reseed") {
+            opts.source_settings.chacha.reseed_bytes = parse_size(value());
+        } else if (arg == "--chacha-reseed-interval") {
+            opts.source_settings.chacha.reseed_interval_s = std::stod(value());
+        } else if (arg == "-t" || arg == "--threads") {
+            opts.threads = std::stoul(value());
+        } else if (arg == "--sweep") {
+            opts.sweep = true;
+        } else if (arg == "--sweep-min") {
+            opts.sweep_min = parse_size(value());
+        } else if (arg == "--sweep-max") {
+            opts.sweep_max = parse_size(value());
+        } else if (arg == "--sweep-steps") {
+            opts.sweep_steps = std::stoul(value());
+        } else if (arg == "--min-time") {
+            opts.sweep_min_time = std::stod(value());
+        } else if (arg == "--load") {
+            opts.load = parse_stress_spec(value());
+        } else if (arg == "--load-levels") {
+            opts.load_levels = std::stoul(value());
+        } else if (arg == "--ab-module") {
+            opts.ab_module = value();
+        } else if (arg == "--ab-module-params") {
+            opts.ab_module_params = value();
+        } else if (arg == "--ab-source") {
+            opts.ab_source = value();
+        } else if (arg == "--ab-blocks") {
+            opts.ab_blocks = std::stoul(value());
+        } else if (arg == "--adaptive") {
+            opts.stopping.adaptive = true;
+        } else if (arg == "--target-ci") {
+            opts.stopping.target_ci = std::stod(value()) / 100.0;
+        } else if (arg == "--time-budget") {
+            opts.stopping.time_budget_s = std::stod(value());
+        } else if (arg == "--min-iterations") {
+            opts.stopping.min_iterations = std::stoul(value());
+        } else if (arg == "--save") {
+            opts.save_path = value();
+        } else if (arg == "--baseline") {
+            opts.baseline_path = value();
+        } else if (arg == "--compare") {
+            opts.compare_baseline = value();
+            opts.compare_candidate = value();
+        } else if (arg == "--max-regression") {
+            opts.max_regression = std::stod(value());
+        } else if (arg == "--clock") {
+            const std::string name = value();
+            if (name != "tsc" && name != "monotonic") {
+                throw std::invalid_argument("Unknown clock: " + name);
+            }
+            opts.tsc = name == "tsc";
+        } else if (arg == "--perf") {
+            opts.perf = true;
+        } else if (arg == "--quality") {
+            opts.quality = true;
+        } else if (arg == "--buffer") {
+            opts.buffer_strategy = value();
+            parse_buffer_strategy(opts.buffer_strategy);
+        } else if (arg == "--buffer-align") {
+            opts.buffer_align = parse_size(value());
+        } else if (arg == "--histogram-only") {
+            opts.histogram_only = true;
+        } else if (arg == "--list-sources") {
+            opts.list_sources = true;
+        } else if (arg == "--no-plot") {
+            opts.plot = false;
+        } else if (arg == "--downsample") {
+            opts.downsample = value();
+            parse_downsampling(opts.downsample);
+        } else if (arg == "--plot-points") {
+            opts.plot_points = std::stoul(value());
+        } else if (arg == "--live-plot") {
+            opts.live_plot = true;
+        } else if (arg == "-h" || arg == "--help") {
+            opts.help = true;
+        } else {
+            throw std::invalid_argument("Unknown option: " + arg);
+        }
+    }
+
+    if (opts.num_experiments == 0 || opts.chunk_size == 0) {
+        throw std::invalid_argument("Iterations and chunk size must be positive");
+    }
+    if (opts.sweep && (opts.sweep_min == 0 || opts.sweep_min > opts.sweep_max)) {
+        throw std::invalid_argument("Sweep range must satisfy 0 < min <= max");
+    }
+    if (!opts.ab_module.empty() && !opts.ab_source.empty()) {
+        throw std::invalid_argument("--ab-module and --ab-source are mutually exclusive");
+    }
+    if (opts.sources.empty()) {
+        throw std::invalid_argument("No entropy source selected");
+    }
+    return opts;
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <ctime>
+#include <cerrno>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define CHACHA_POOL_AVX2 1
+#include <immintrin.h>
+#else
+#define CHACHA_POOL_AVX2 0
+#endif
+
+// Userspace ChaCha20 keystream pool, seeded from getrandom(2). Small requests
+// are served from a per-pool keystream buffer instead of one syscall each.
+//
+// Every refill uses a fresh key: the first 32 bytes of each new buffer become
+// the next key and are wiped, and consumed output is zeroed ("fast key
+// erasure", as in OpenBSD arc4random), so a later state leak cannot recover
+// earlier output. The key is mixed with new getrandom bytes once reseed_bytes
+// have been produced or reseed_interval_s has passed, whichever comes first.
+//
+// A pool must not be shared between threads; chacha_random_bytes() uses one
+// thread_local pool per thread. The state lives on pages marked
+// MADV_WIPEONFORK, and a pthread_atfork generation counter backs that up, so
+// a forked child never repeats its parent's stream.
+
+struct ChaChaReseedPolicy {
+    uint64_t reseed_bytes = 1ULL << 20;  // 1 MB
+    double reseed_interval_s = 5.0;      // 0 = bytes only
+};
+
+namespace chacha_detail {
+
+constexpr uint32_t SIGMA[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};  // "expand 32-byte k"
+
+inline uint32_t rotl(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+inline void quarter_round(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+    a += b; d ^= a; d = rotl(d, 16);
+    c += d; b ^= c; b = rotl(b, 12);
+    a += b; d ^= a; d = rotl(d, 8);
+    c += d; b ^= c; b = rotl(b, 7);
+}
+
+// Words 12-13 hold a 64-bit block counter and 14-15 a 64-bit nonce (the
+// original Bernstein layout); with counter < 2^32 and the nonce's low word
+// in word 13 this is also the RFC 8439 block function.
+inline void blocks_scalar(const uint32_t key[8], uint64_t counter, uint64_t nonce,
+                          unsigned char* out, size_t blocks) {
+    for (size_t b = 0; b < blocks; ++b, ++counter) {
+        uint32_t in[16] = {
+            SIGMA[0], SIGMA[1], SIGMA[2], SIGMA[3],
+            key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+            static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+            static_cast<uint32_t>(nonce), static_cast<uint32_t>(nonce >> 32),
+        };
+        uint32_t x[16];
+        std::memcpy(x, in, sizeof(x));
+        for (int round = 0; round < 10; ++round) {
+            quarter_round(x[0], x[4], x[8], x[12]);
+            quarter_round(x[1], x[5], x[9], x[13]);
+            quarter_round(x[2], x[6], x[10], x[14]);
+            quarter_round(x[3], x[7], x[11], x[15]);
+            quarter_round(x[0], x[5], x[10], x[15]);
+            quarter_round(x[1], x[6], x[11], x[12]);
+            quarter_round(x[2], x[7], x[8], x[13]);
+            quarter_round(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; ++i) {
+            const uint32_t word = x[i] + in[i];
+            const unsigned char bytes[4] = {
+                static_cast<unsigned char>(word), static_cast<unsigned char>(word >> 8),
+                static_cast<unsigned char>(word >> 16), static_cast<unsigned char>(word >> 24),
+            };
+            std::memcpy(out + 64 * b + 4 * i, bytes, 4);
+        }
+    }
+}
+
+#if CHACHA_POOL_AVX2
+__attribute__((target("avx2")))
+inline __m256i rotl_avx2(__m256i v, int n) {
+    return _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n));
+}
+
+__attribute__((target("avx2")))
+inline void quarter_round_avx2(__m256i& a, __m256i& b, __m256i& c, __m256i& d) {
+    // 16- and 8-bit rotations are byte shuffles
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                          3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);
+    c = _mm256_add_epi32(c, d); b = rotl_avx2(_mm256_xor_si256(b, c), 12);
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);
+    c = _mm256_add_epi32(c, d); b = rotl_avx2(_mm256_xor_si256(b, c), 7);
+}
+
+// r[i] holds word (first + i) of eight consecutive blocks; writes those 32
+// bytes of each block in place with an 8x8 transpose.
+__attribute__((target("avx2")))
+inline void store_transposed(const __m256i* r, unsigned char* out, size_t first) {
+    const __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    const __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    const __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    const __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+    const __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+    const __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+    const __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+    const __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    const __m256i rows[8] = {
+        _mm256_permute2x128_si256(u0, u4, 0x20), _mm256_permute2x128_si256(u1, u5, 0x20),
+        _mm256_permute2x128_si256(u2, u6, 0x20), _mm256_permute2x128_si256(u3, u7, 0x20),
+        _mm256_permute2x128_si256(u0, u4, 0x31), _mm256_permute2x128_si256(u1, u5, 0x31),
+        _mm256_permute2x128_si256(u2, u6, 0x31), _mm256_permute2x128_si256(u3, u7, 0x31),
+    };
+    for (size_t block = 0; block < 8; ++block) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 64 * block + 4 * first), rows[block]);
+    }
+}
+
+// Eight blocks per iteration, one block per 32-bit lane
+__attribute__((target("avx2")))
+inline void blocks_avx2(const uint32_t key[8], uint64_t counter, uint64_t nonce,
+                        unsigned char* out, size_t blocks) {
+    size_t b = 0;
+    for (; b + 8 <= blocks; b += 8) {
+        alignas(32) uint32_t lo[8], hi[8];
+        for (int i = 0; i < 8; ++i) {
+            const uint64_t c = counter + b + i;
+            lo[i] = static_cast<uint32_t>(c);
+            hi[i] = static_cast<uint32_t>(c >> 32);
+        }
+
+        __m256i in[16], x[16];
+        for (int i = 0; i < 4; ++i) in[i] = _mm256_set1_epi32(static_cast<int>(SIGMA[i]));
+        for (int i = 0; i < 8; ++i) in[4 + i] = _mm256_set1_epi32(static_cast<int>(key[i]));
+        in[12] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lo));
+        in[13] = _mm256_load_si256(reinterpret_cast<const __m256i*>(hi));
+        in[14] = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(nonce)));
+        in[15] = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(nonce >> 32)));
+        for (int i = 0; i < 16; ++i) x[i] = in[i];
+
+        for (int round = 0; round < 10; ++round) {
+            quarter_round_avx2(x[0], x[4], x[8], x[12]);
+            quarter_round_avx2(x[1], x[5], x[9], x[13]);
+            quarter_round_avx2(x[2], x[6], x[10], x[14]);
+            quarter_round_avx2(x[3], x[7], x[11], x[15]);
+            quarter_round_avx2(x[0], x[5], x[10], x[15]);
+            quarter_round_avx2(x[1], x[6], x[11], x[12]);
+            quarter_round_avx2(x[2], x[7], x[8], x[13]);
+            quarter_round_avx2(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; ++i) x[i] = _mm256_add_epi32(x[i], in[i]);
+
+        store_transposed(x, out + 64 * b, 0);
+        store_transposed(x + 8, out + 64 * b, 8);
+    }
+    blocks_scalar(key, counter + b, nonce, out + 64 * b, blocks - b);
+}
+#endif
+
+using BlockFunction = void (*)(const uint32_t*, uint64_t, uint64_t, unsigned char*, size_t);
+
+inline BlockFunction best_block_function() {
+#if CHACHA_POOL_AVX2
+    return __builtin_cpu_supports("avx2") ? blocks_avx2 : blocks_scalar;
+#else
+    return blocks_scalar;
+#endif
+}
+
+// Bumped in every forked child; pools compare it against their seed-time value
+inline std::atomic<unsigned>& fork_generation() {
+    static std::atomic<unsigned> generation{0};
+    static std::once_flag registered;
+    std::call_once(registered, [] {
+        pthread_atfork(nullptr, nullptr, [] { fork_generation().fetch_add(1, std::memory_order_relaxed); });
+    });
+    return generation;
+}
+
+inline int64_t monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+} // namespace chacha_detail
+
+class ChaChaPool {
+public:
+    static constexpr size_t BUFFER_SIZE = 8192;       // keystream per refill
+    static constexpr size_t KEY_SIZE = 32;
+    static constexpr size_t DIRECT_CHUNK = 1 << 20;   // big requests are generated in place, per key
+
+    explicit ChaChaPool(const ChaChaReseedPolicy& policy = {}, bool allow_simd = true)
+        : policy_(policy),
+          blocks_(allow_simd ? chacha_detail::best_block_function() : chacha_detail::blocks_scalar) {
+        map_size_ = (sizeof(State) + getpagesize() - 1) / getpagesize() * getpagesize();
+        void* mem = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            throw std::runtime_error("ChaChaPool: mmap failed: " + std::string(strerror(errno)));
+        }
+        // Best effort (Linux 4.14+); the atfork generation covers older kernels
+        madvise(mem, map_size_, MADV_WIPEONFORK);
+        madvise(mem, map_size_, MADV_DONTDUMP);
+        state_ = static_cast<State*>(mem);
+    }
+
+    ~ChaChaPool() {
+        if (state_) {
+            explicit_bzero(state_, sizeof(State));
+            munmap(state_, map_size_);
+        }
+    }
+
+    ChaChaPool(const ChaChaPool&) = delete;
+    ChaChaPool& operator=(const ChaChaPool&) = delete;
+
+    const char* kernel_name() const {
+        return blocks_ == chacha_detail::blocks_scalar ? "scalar" : "AVX2";
+    }
+    uint64_t reseeds() const { return reseeds_; }
+
+    void fill(void* data, size_t len) {
+        auto* out = static_cast<unsigned char*>(data);
+        State& s = *state_;
+        if (!s.seeded || s.generation != chacha_detail::fork_generation().load(std::memory_order_relaxed)) {
+            reseed();
+        }
+
+        while (len > 0) {
+            if (s.pos == BUFFER_SIZE && len >= BUFFER_SIZE) {
+                const size_t n = std::min(len, DIRECT_CHUNK) & ~size_t(63);
+                generate_direct(out, n);
+                out += n;
+                len -= n;
+                continue;
+            }
+            if (s.pos == BUFFER_SIZE) refill();
+
+            const size_t take = std::min(len, BUFFER_SIZE - s.pos);
+            std::memcpy(out, s.buffer + s.pos, take);
+            std::memset(s.buffer + s.pos, 0, take);
+            s.pos += take;
+            out += take;
+            len -= take;
+        }
+    }
+
+private:
+    struct State {
+        uint32_t key[8];
+        size_t pos;                   // next unread byte of buffer
+        uint64_t bytes_since_reseed;
+        int64_t reseeded_at_ns;
+        unsigned generation;
+        bool seeded;                  // zero after fork thanks to MADV_WIPEONFORK
+        alignas(64) unsigned char buffer[BUFFER_SIZE];
+    };
+
+    ChaChaReseedPolicy policy_;
+    chacha_detail::BlockFunction blocks_;
+    State* state_ = nullptr;
+    size_t map_size_ = 0;
+    uint64_t reseeds_ = 0;
+
+    // XORs fresh kernel entropy into the key; the old key only adds to it
+    void reseed() {
+        State& s = *state_;
+        uint32_t fresh[8];
+        size_t got = 0;
+        while (got < sizeof(fresh)) {
+            ssize_t n = getrandom(reinterpret_cast<char*>(fresh) + got, sizeof(fresh) - got, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("ChaChaPool: getrandom failed: " + std::string(strerror(errno)));
+            }
+            got += static_cast<size_t>(n);
+        }
+        if (!s.seeded) std::memset(s.key, 0, sizeof(s.key));
+        for (int i = 0; i < 8; ++i) s.key[i] ^= fresh[i];
+        explicit_bzero(fresh, sizeof(fresh));
+
+        s.pos = BUFFER_SIZE;  // discard keystream made with the old key
+        std::memset(s.buffer, 0, BUFFER_SIZE);
+        s.bytes_since_reseed = 0;
+        s.reseeded_at_ns = chacha_detail::monotonic_ns();
+        s.generation = chacha_detail::fork_generation().load(std::memory_order_relaxed);
+        s.seeded = true;
+        ++reseeds_;
+    }
+
+    void maybe_reseed() {
+        const State& s = *state_;
+        if (s.bytes_since_reseed >= policy_.reseed_bytes ||
+            (policy_.reseed_interval_s > 0 &&
+             chacha_detail::monotonic_ns() - s.reseeded_at_ns >= policy_.reseed_interval_s * 1e9)) {
+            reseed();
+        }
+    }
+
+    void refill() {
+        maybe_reseed();
+        State& s = *state_;
+        blocks_(s.key, 0, 0, s.buffer, BUFFER_SIZE / 64);
+        std::memcpy(s.key, s.buffer, KEY_SIZE);
+        std::memset(s.buffer, 0, KEY_SIZE);
+        s.pos = KEY_SIZE;
+        s.bytes_since_reseed += BUFFER_SIZE;
+    }
+
+    // Keystream straight into the caller's memory, then one extra block for
+    // the next key so the key used here is never used again.
+    void generate_direct(unsigned char* out, size_t len) {
+        maybe_reseed();
+        State& s = *state_;
+        const size_t blocks = len / 64;
+        blocks_(s.key, 0, 0, out, blocks);
+
+        unsigned char next[64];
+        blocks_(s.key, blocks, 0, next, 1);
+        std::memcpy(s.key, next, KEY_SIZE);
+        explicit_bzero(next, sizeof(next));
+        s.bytes_since_reseed += len;
+    }
+};
+
+// Per-thread pool with the default policy; no syscall for most calls
+inline void chacha_random_bytes(void* out, size_t len) {
+    thread_local ChaChaPool pool;
+    pool.fill(out, len);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include "source_factory.hpp"
+#include "graph_plotter.hpp"
+#include "size_units.hpp"
+
+// Steps through log-spaced request sizes and measures ops/s and bytes/s at
+// each one. The number of calls per size is found the way Google Benchmark
+// does it: grow the batch until one batch runs for at least min_time, so a
+// 1-byte read is timed over millions of calls and a 64 MB read over a few.
+class ChunkSweepBenchmark {
+public:
+    struct SizePoint {
+        size_t size = 0;
+        size_t calls = 0;
+        double elapsed_s = 0;
+        double ops_per_sec = 0;
+        double bytes_per_sec = 0;
+        double ns_per_call = 0;
+    };
+
+    ChunkSweepBenchmark(std::string source, size_t min_size, size_t max_size,
+                        size_t steps_per_octave, double min_time_s, const SourceSettings& settings = {})
+        : source_name_(std::move(source)),
+          MIN_SIZE(min_size),
+          MAX_SIZE(max_size),
+          STEPS_PER_OCTAVE(std::max<size_t>(1, steps_per_octave)),
+          MIN_TIME_S(min_time_s),
+          source_(make_entropy_source(source_name_, settings)),
+          buffer_(max_size) {}
+
+    void run() {
+        const auto sizes = sweep_sizes();
+        std::cout << "Starting " << source_name_ << " chunk sweep: " << sizes.size() << " sizes from "
+                  << format_size(MIN_SIZE) << " to " << format_size(MAX_SIZE)
+                  << ", at least " << MIN_TIME_S << " s each\n";
+
+        for (size_t size : sizes) {
+            points_.push_back(measure(size));
+            print_point(points_.back());
+        }
+
+        analyze_results();
+    }
+
+    const std::string& source_name() const { return source_name_; }
+    const std::vector<SizePoint>& points() const { return points_; }
+
+    void add_throughput_graph(GraphPlotter& plotter) const {
+        std::vector<std::pair<double, double>> curve;
+        for (const auto& p : points_) {
+            curve.emplace_back(p.size, p.bytes_per_sec / 1e6);
+        }
+        plotter.addGraph(source_name_ + " MB/s", std::move(curve));
+    }
+
+    void add_ops_graph(GraphPlotter& plotter) const {
+        std::vector<std::pair<double, double>> curve;
+        for (const auto& p : points_) {
+            curve.emplace_back(p.size, p.ops_per_sec);
+        }
+        plotter.addGraph(source_name_ + " ops/s", std::move(curve));
+    }
+
+private:
+    const std::string source_name_;
+    const size_t MIN_SIZE;
+    const size_t MAX_SIZE;
+    const size_t STEPS_PER_OCTAVE;
+    const double MIN_TIME_S;
+    std::unique_ptr<EntropySource> source_;
+    std::vector<char> buffer_;
+    std::vector<SizePoint> points_;
+
+    std::vector<size_t> sweep_sizes() const {
+        std::vector<size_t> sizes;
+        const double ratio = std::pow(2.0, 1.0 / STEPS_PER_OCTAVE);
+        for (double s = MIN_SIZE; s <= MAX_SIZE * 1.0000001; s *= ratio) {
+            size_t size = static_cast<size_t>(std::llround(s));
+            if (sizes.empty() || size != sizes.back()) sizes.push_back(size);
+        }
+        if (sizes.back() != MAX_SIZE) sizes.push_back(MAX_SIZE);
+        return sizes;
+    }
+
+    double time_batch(size_t size, size_t calls) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < calls; ++i) {
+            source_->fill(buffer_.data(), size);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    SizePoint measure(size_t size) {
+        size_t calls = 1;
+        double elapsed = time_batch(size, calls);
+        while (elapsed < MIN_TIME_S) {
+            // Aim 40% past the target so the next batch usually suffices,
+            // but never grow by more than 10x on a noisy estimate
+            double factor = elapsed > 0 ? MIN_TIME_S / elapsed * 1.4 : 10.0;
+            factor = std::clamp(factor, 2.0, 10.0);
+            calls = static_cast<size_t>(calls * factor);
+            elapsed = time_batch(size, calls);
+        }
+
+        SizePoint p;
+        p.size = size;
+        p.calls = calls;
+        p.elapsed_s = elapsed;
+        p.ops_per_sec = calls / elapsed;
+        p.bytes_per_sec = p.ops_per_sec * size;
+        p.ns_per_call = elapsed * 1e9 / calls;
+        return p;
+    }
+
+    void print_point(const SizePoint& p) const {
+        std::cout << std::setw(8) << format_size(p.size) << ": "
+                  << std::setw(10) << p.calls << " calls, "
+                  << std::setw(12) << p.ns_per_call << " ns/call, "
+                  << std::setw(12) << p.ops_per_sec << " ops/s, "
+                  << std::setw(10) << p.bytes_per_sec / 1e6 << " MB/s\n";
+    }
+
+    // Models the per-call cost as t(size) = overhead + size / bandwidth: the
+    // smallest size gives the fixed syscall overhead, the best bytes/s the
+    // copy bandwidth, and their product the size at which both cost the same.
+    void analyze_results() const {
+        const auto& smallest = points_.front();
+        const auto peak = std::max_element(points_.begin(), points_.end(),
+            [](const SizePoint& a, const SizePoint& b) { return a.bytes_per_sec < b.bytes_per_sec; });
+
+        const double overhead_ns = smallest.ns_per_call;
+        const double bandwidth = peak->bytes_per_sec;
+        const double crossover = overhead_ns * 1e-9 * bandwidth;
+
+        std::cout << "\n=== Chunk Sweep Results (" << source_name_ << ") ===\n"
+                  << "Per-call overhead: " << overhead_ns << " ns (at " << format_size(smallest.size) << ")\n"
+                  << "Peak throughput: " << bandwidth / 1e6 << " MB/s (at " << format_size(peak->size) << ")\n"
+                  << "Overhead/copy crossover: ~" << static_cast<size_t>(crossover) << " bytes\n";
+
+        const auto half = std::find_if(points_.begin(), points_.end(),
+            [&](const SizePoint& p) { return p.bytes_per_sec >= bandwidth / 2; });
+        if (half != points_.end()) {
+            std::cout << "Half of peak throughput reached at: " << format_size(half->size) << "\n";
+        }
+    }
+};
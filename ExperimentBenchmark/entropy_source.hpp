@@ -0,0 +1,319 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <fcntl.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <unistd.h>
+#include "latency_histogram.hpp"
+#include "chacha_pool.hpp"
+
+#ifndef GRND_INSECURE
+#define GRND_INSECURE 0x0004
+#endif
+
+// Common interface for every way of pulling bytes out of the kernel RNG.
+// fill() must either fill exactly len bytes or throw std::runtime_error.
+// Instances are not thread-safe: every reader thread creates its own.
+class EntropySource {
+public:
+    virtual ~EntropySource() = default;
+    virtual std::string name() const = 0;
+    virtual void fill(char* buf, size_t len) = 0;
+
+    // Costs a source measures on its own, separately from the read time
+    // timed around fill(): open()/close() for file sources, submit-to-
+    // completion time for asynchronous ones. Values are in ns.
+    virtual std::vector<std::pair<std::string, const LatencyHistogram*>> extra_latencies() const {
+        return {};
+    }
+};
+
+// Opens the character device on every call and reads through iostreams,
+// which is what the benchmark originally measured.
+class DeviceStreamSource : public EntropySource {
+public:
+    DeviceStreamSource(std::string label, std::string path)
+        : label_(std::move(label)), path_(std::move(path)) {}
+
+    std::string name() const override { return label_; }
+
+    void fill(char* buf, size_t len) override {
+        std::ifstream device(path_, std::ios::binary);
+        if (!device) {
+            throw std::runtime_error("Failed to open " + path_);
+        }
+
+        device.read(buf, len);
+
+        if (!device) {
+            throw std::runtime_error("Failed to read from " + path_);
+        }
+    }
+
+private:
+    std::string label_;
+    std::string path_;
+};
+
+// Raw read(2)/pread(2) on a device, bypassing iostreams. In the persistent
+// modes the device is opened once, the way a service keeps a long-lived fd;
+// in OpenPerCall every fill() does open/read/close with each step timed.
+class DeviceFdSource : public EntropySource {
+public:
+    enum class Mode { Read, Pread, OpenPerCall };
+
+    DeviceFdSource(std::string label, std::string path, Mode mode)
+        : label_(std::move(label)), path_(std::move(path)), mode_(mode) {
+        if (mode_ != Mode::OpenPerCall) {
+            fd_ = timed_open();
+        }
+    }
+
+    ~DeviceFdSource() override {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    DeviceFdSource(const DeviceFdSource&) = delete;
+    DeviceFdSource& operator=(const DeviceFdSource&) = delete;
+
+    std::string name() const override { return label_; }
+
+    void fill(char* buf, size_t len) override {
+        if (mode_ == Mode::OpenPerCall) {
+            int fd = timed_open();
+            read_fully(fd, buf, len);
+            timed_close(fd);
+        } else {
+            read_fully(fd_, buf, len);
+        }
+    }
+
+    std::vector<std::pair<std::string, const LatencyHistogram*>> extra_latencies() const override {
+        return {{"Open", &open_latency_}, {"Close", &close_latency_}};
+    }
+
+private:
+    std::string label_;
+    std::string path_;
+    Mode mode_;
+    int fd_ = -1;
+    LatencyHistogram open_latency_;
+    LatencyHistogram close_latency_;
+
+    int timed_open() {
+        auto start = std::chrono::steady_clock::now();
+        int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        auto end = std::chrono::steady_clock::now();
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open " + path_ + ": " + std::strerror(errno));
+        }
+        open_latency_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        return fd;
+    }
+
+    void timed_close(int fd) {
+        auto start = std::chrono::steady_clock::now();
+        close(fd);
+        auto end = std::chrono::steady_clock::now();
+        close_latency_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    void read_fully(int fd, char* buf, size_t len) {
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = mode_ == Mode::Pread ? pread(fd, buf + done, len - done, 0)
+                                             : read(fd, buf + done, len - done);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("Failed to read from " + path_ + ": " + std::strerror(errno));
+            }
+            if (n == 0) {
+                throw std::runtime_error("Unexpected end of file on " + path_);
+            }
+            done += static_cast<size_t>(n);
+        }
+    }
+};
+
+// getrandom(2) with an explicit flag combination.
+class GetrandomSource : public EntropySource {
+public:
+    GetrandomSource(std::string label, unsigned int flags)
+        : label_(std::move(label)), flags_(flags) {}
+
+    std::string name() const override { return label_; }
+
+    void fill(char* buf, size_t len) override {
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = getrandom(buf + done, len - done, flags_);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(label_ + ": getrandom failed: " + std::strerror(errno));
+            }
+            done += static_cast<size_t>(n);
+        }
+    }
+
+private:
+    std::string label_;
+    unsigned int flags_;
+};
+
+// getentropy(3) is capped at 256 bytes per call, so larger requests loop.
+class GetentropySource : public EntropySource {
+public:
+    static constexpr size_t MAX_CALL_SIZE = 256;
+
+    std::string name() const override { return "getentropy"; }
+
+    void fill(char* buf, size_t len) override {
+        for (size_t done = 0; done < len; done += MAX_CALL_SIZE) {
+            size_t part = std::min(MAX_CALL_SIZE, len - done);
+            if (getentropy(buf + done, part) != 0) {
+                throw std::runtime_error(std::string("getentropy failed: ") + std::strerror(errno));
+            }
+        }
+    }
+};
+
+// Direct call into the vDSO getrandom (Linux 6.11+), bypassing libc. The
+// symbol is looked up in the vDSO image and every instance owns the opaque
+// per-thread state the kernel asks for.
+class VdsoGetrandomSource : public EntropySource {
+public:
+    VdsoGetrandomSource() {
+        vgetrandom_ = reinterpret_cast<VdsoGetrandomFn>(lookup_vdso_symbol("__vdso_getrandom"));
+        if (!vgetrandom_) {
+            throw std::runtime_error("vDSO getrandom is not provided by this kernel");
+        }
+
+        OpaqueParams params{};
+        if (vgetrandom_(nullptr, 0, 0, &params, ~0UL) != 0) {
+            throw std::runtime_error("vDSO getrandom refused the opaque state query");
+        }
+
+        state_size_ = params.size_of_opaque_state;
+        mapping_size_ = (state_size_ + getpagesize() - 1) & ~static_cast<size_t>(getpagesize() - 1);
+        state_ = mmap(nullptr, mapping_size_, params.mmap_prot, params.mmap_flags, -1, 0);
+        if (state_ == MAP_FAILED) {
+            throw std::runtime_error(std::string("Failed to map vDSO getrandom state: ") + std::strerror(errno));
+        }
+    }
+
+    ~VdsoGetrandomSource() override {
+        munmap(state_, mapping_size_);
+    }
+
+    VdsoGetrandomSource(const VdsoGetrandomSource&) = delete;
+    VdsoGetrandomSource& operator=(const VdsoGetrandomSource&) = delete;
+
+    std::string name() const override { return "vdso-getrandom"; }
+
+    void fill(char* buf, size_t len) override {
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = vgetrandom_(buf + done, len - done, 0, state_, state_size_);
+            if (n < 0) {
+                if (n == -EINTR) continue;
+                throw std::runtime_error(std::string("vDSO getrandom failed: ") + std::strerror(static_cast<int>(-n)));
+            }
+            done += static_cast<size_t>(n);
+        }
+    }
+
+    static bool available() {
+        return lookup_vdso_symbol("__vdso_getrandom") != nullptr;
+    }
+
+private:
+    using VdsoGetrandomFn = ssize_t (*)(void*, size_t, unsigned int, void*, size_t);
+
+    // Mirrors struct vgetrandom_opaque_params from <linux/random.h>
+    struct OpaqueParams {
+        uint32_t size_of_opaque_state;
+        uint32_t mmap_prot;
+        uint32_t mmap_flags;
+        uint32_t reserved[13];
+    };
+
+    VdsoGetrandomFn vgetrandom_ = nullptr;
+    void* state_ = nullptr;
+    size_t state_size_ = 0;
+    size_t mapping_size_ = 0;
+
+    // Minimal walk of the vDSO dynamic symbol table, in the spirit of the
+    // kernel's tools/testing/selftests/vDSO/parse_vdso.c.
+    static void* lookup_vdso_symbol(const char* symbol) {
+        auto base = getauxval(AT_SYSINFO_EHDR);
+        if (!base) return nullptr;
+
+        auto* ehdr = reinterpret_cast<const ElfW(Ehdr)*>(base);
+        auto* phdr = reinterpret_cast<const ElfW(Phdr)*>(base + ehdr->e_phoff);
+
+        uintptr_t load_offset = 0;
+        const ElfW(Dyn)* dynamic = nullptr;
+        for (int i = 0; i < ehdr->e_phnum; ++i) {
+            if (phdr[i].p_type == PT_LOAD && !load_offset) {
+                load_offset = base + phdr[i].p_offset - phdr[i].p_vaddr;
+            } else if (phdr[i].p_type == PT_DYNAMIC) {
+                dynamic = reinterpret_cast<const ElfW(Dyn)*>(base + phdr[i].p_offset);
+            }
+        }
+        if (!load_offset || !dynamic) return nullptr;
+
+        const ElfW(Sym)* symtab = nullptr;
+        const char* strtab = nullptr;
+        const ElfW(Word)* hash = nullptr;
+        for (auto* dyn = dynamic; dyn->d_tag != DT_NULL; ++dyn) {
+            switch (dyn->d_tag) {
+                case DT_SYMTAB: symtab = reinterpret_cast<const ElfW(Sym)*>(dyn->d_un.d_ptr + load_offset); break;
+                case DT_STRTAB: strtab = reinterpret_cast<const char*>(dyn->d_un.d_ptr + load_offset); break;
+                case DT_HASH:   hash = reinterpret_cast<const ElfW(Word)*>(dyn->d_un.d_ptr + load_offset); break;
+            }
+        }
+        if (!symtab || !strtab || !hash) return nullptr;
+
+        // DT_HASH layout: nbucket, nchain, ...; nchain equals the symbol count
+        const ElfW(Word) symbol_count = hash[1];
+        for (ElfW(Word) i = 0; i < symbol_count; ++i) {
+            const auto& sym = symtab[i];
+            if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_shndx == SHN_UNDEF) continue;
+            if (std::strcmp(strtab + sym.st_name, symbol) == 0) {
+                return reinterpret_cast<void*>(sym.st_value + load_offset);
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Userspace ChaCha20 pool reseeded from getrandom; each source owns its own
+// pool, so reader threads never share one.
+class ChaChaPoolSource : public EntropySource {
+public:
+    ChaChaPoolSource(std::string label, const ChaChaReseedPolicy& policy, bool allow_simd)
+        : label_(std::move(label)), pool_(policy, allow_simd) {}
+
+    std::string name() const override { return label_; }
+
+    void fill(char* buf, size_t len) override {
+        pool_.fill(buf, len);
+    }
+
+private:
+    std::string label_;
+    ChaChaPool pool_;
+};
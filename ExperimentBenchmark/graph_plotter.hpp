@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <vector>
 #include <string>
@@ -8,6 +10,125 @@
 #include <limits>
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <chrono>
+#include <array>
+
+// Reduces a series to at most maxPoints for drawing. MinMax keeps the lowest
+// and highest point of every bucket, so no spike is ever lost; Lttb
+// (largest triangle three buckets) keeps the visually most significant
+// point per bucket and draws smoother lines. Both run in one pass.
+enum class Downsampling { None, MinMax, Lttb };
+
+inline Downsampling parse_downsampling(const std::string& name) {
+    if (name == "minmax") return Downsampling::MinMax;
+    if (name == "lttb") return Downsampling::Lttb;
+    if (name == "none") return Downsampling::None;
+    throw std::invalid_argument("Unknown downsampling: " + name + " (minmax, lttb or none)");
+}
+
+// One quantile estimated in constant memory with the P-square algorithm
+// (Jain & Chlamtac 1985): five markers whose heights follow the running
+// quantile, adjusted by parabolic interpolation on every sample.
+class P2Quantile {
+public:
+    explicit P2Quantile(double p) : p_(p), increments_{0, p / 2, p, (1 + p) / 2, 1} {}
+
+    void add(double x) {
+        if (count_ < 5) {
+            heights_[count_++] = x;
+            if (count_ == 5) {
+                std::sort(heights_.begin(), heights_.end());
+                for (int i = 0; i < 5; ++i) positions_[i] = i + 1;
+                desired_ = {1, 1 + 2 * p_, 1 + 4 * p_, 3 + 2 * p_, 5};
+            }
+            return;
+        }
+        ++count_;
+
+        int k;
+        if (x < heights_[0]) {
+            heights_[0] = x;
+            k = 0;
+        } else if (x >= heights_[4]) {
+            heights_[4] = x;
+            k = 3;
+        } else {
+            k = 0;
+            while (x >= heights_[k + 1]) ++k;
+        }
+        for (int i = k + 1; i < 5; ++i) ++positions_[i];
+        for (int i = 0; i < 5; ++i) desired_[i] += increments_[i];
+
+        for (int i = 1; i < 4; ++i) {
+            const double d = desired_[i] - positions_[i];
+            if ((d >= 1 && positions_[i + 1] - positions_[i] > 1) || (d <= -1 && positions_[i - 1] - positions_[i] < -1)) {
+                const int step = d > 0 ? 1 : -1;
+                double h = parabolic(i, step);
+                if (h <= heights_[i - 1] || h >= heights_[i + 1]) {
+                    h = heights_[i] + step * (heights_[i + step] - heights_[i]) / (positions_[i + step] - positions_[i]);
+                }
+                heights_[i] = h;
+                positions_[i] += step;
+            }
+        }
+    }
+
+    double value() const {
+        if (count_ == 0) return 0;
+        if (count_ < 5) {
+            std::array<double, 5> sorted = heights_;
+            std::sort(sorted.begin(), sorted.begin() + count_);
+            return sorted[static_cast<size_t>(p_ * (count_ - 1) + 0.5)];
+        }
+        return heights_[2];
+    }
+
+private:
+    double p_;
+    size_t count_ = 0;
+    std::array<double, 5> heights_{};
+    std::array<double, 5> positions_{};
+    std::array<double, 5> desired_{};
+    std::array<double, 5> increments_;
+
+    double parabolic(int i, int d) const {
+        const double n0 = positions_[i - 1], n1 = positions_[i], n2 = positions_[i + 1];
+        return heights_[i] + d / (n2 - n0) *
+               ((n1 - n0 + d) * (heights_[i + 1] - heights_[i]) / (n2 - n1) +
+                (n2 - n1 - d) * (heights_[i] - heights_[i - 1]) / (n1 - n0));
+    }
+};
+
+// Statistics of a series' y values, updated in O(1) per point: extremes,
+// Welford mean and variance, P-square estimates of the median and p99
+struct SeriesStats {
+    size_t count = 0;
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double m2 = 0;  // sum of squared deviations from the mean
+    P2Quantile p50{0.5};
+    P2Quantile p99{0.99};
+
+    void add(double y) {
+        if (count == 0) {
+            min = max = y;
+        } else {
+            min = std::min(min, y);
+            max = std::max(max, y);
+        }
+        ++count;
+        const double delta = y - mean;
+        mean += delta / count;
+        m2 += delta * (y - mean);
+        p50.add(y);
+        p99.add(y);
+    }
+
+    double variance() const { return count > 1 ? m2 / (count - 1) : 0; }
+};
 
 class GraphPlotter {
 private:
@@ -17,6 +138,10 @@ private:
         bool enabled = true;
         std::string lineStyle = "lines";  // Default style
         std::string color;                // Empty = auto
+        size_t capacity = 0;              // live graphs: ring size, 0 = plain series
+        size_t head = 0;                  // live graphs: oldest point once the ring is full
+        SeriesStats stats;                // over every point ever added
+        bool statsValid = false;
     };
 
     std::vector<Graph> graphs;
@@ -27,22 +152,76 @@ private:
     bool logY = false;
     bool gridEnabled = true;
     bool showStats = true;
+    Downsampling downsampling = Downsampling::MinMax;
+    size_t maxPoints = 10000;  // per graph, far more than a window has pixels
+
+    // Live mode
+    FILE* livePipe = nullptr;
+    std::chrono::steady_clock::duration refreshInterval{};
+    std::chrono::steady_clock::time_point lastRefresh;
 
 public:
-    // Graph management
+    GraphPlotter() = default;
+    GraphPlotter(const GraphPlotter&) = delete;
+    GraphPlotter& operator=(const GraphPlotter&) = delete;
+
+    ~GraphPlotter() {
+        if (livePipe) pclose(livePipe);
+    }
+
+    // Graph management. The rvalue overload takes the points over without a
+    // copy; pass std::move(curve) when the caller is done with it.
+    void addGraph(const std::string& name, std::vector<std::pair<double, double>>&& points) {
+        Graph graph;
+        graph.name = name;
+        graph.data = std::move(points);
+        graphs.push_back(std::move(graph));
+    }
+
     void addGraph(const std::string& name, const std::vector<std::pair<double, double>>& points) {
-        graphs.push_back({name, points, true});
+        addGraph(name, std::vector<std::pair<double, double>>(points));
     }
 
-    void addGraph(const std::string& name, const std::vector<double>& discretes, double startX = 0, double step = 1) {
+    // y values at startX, startX + step, ...; pointer and count so any
+    // contiguous storage can be plotted without building a vector first
+    void addGraph(const std::string& name, const double* values, size_t count, double startX = 0, double step = 1) {
         std::vector<std::pair<double, double>> res;
-        res.reserve(discretes.size());
-        for (size_t i = 0; i < discretes.size(); ++i) {
-            res.emplace_back(startX + step * i, discretes[i]);
+        res.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            res.emplace_back(startX + step * i, values[i]);
         }
-        graphs.push_back({name, res});
+        addGraph(name, std::move(res));
     }
 
+    void addGraph(const std::string& name, const std::vector<double>& discretes, double startX = 0, double step = 1) {
+        addGraph(name, discretes.data(), discretes.size(), startX, step);
+    }
+
+    // Live graph keeping the last `capacity` points appended; returns its index
+    size_t addLiveGraph(const std::string& name, size_t capacity) {
+        Graph graph;
+        graph.name = name;
+        graph.capacity = std::max<size_t>(capacity, 1);
+        graph.data.reserve(graph.capacity);
+        graph.statsValid = true;  // maintained by append()
+        graphs.push_back(std::move(graph));
+        return graphs.size() - 1;
+    }
+
+    // O(1): overwrites the oldest point once the ring is full
+    void append(size_t index, double x, double y) {
+        Graph& graph = graphs.at(index);
+        if (graph.data.size() < graph.capacity) {
+            graph.data.emplace_back(x, y);
+        } else {
+            graph.data[graph.head] = {x, y};
+            graph.head = (graph.head + 1) % graph.capacity;
+        }
+        graph.stats.add(y);
+    }
+
+    size_t graphCount() const { return graphs.size(); }
+
     void removeGraph(size_t index) {
         if (index < graphs.size()) {
             graphs.erase(graphs.begin() + index);
@@ -64,6 +243,10 @@ public:
     void setLogScale(bool xLog, bool yLog) { logX = xLog; logY = yLog; }
     void setGrid(bool enabled) { gridEnabled = enabled; }
     void setShowStats(bool enabled) { showStats = enabled; }
+    void setDownsampling(Downsampling mode, size_t points = 10000) {
+        downsampling = mode;
+        maxPoints = std::max<size_t>(points, 4);
+    }
 
     // Interactive controls
     void toggleGraphs() {
@@ -101,74 +284,224 @@ public:
         }
     }
 
-    // Plot generation
+    // Plot generation: script and data go to gnuplot over one pipe, the data
+    // as inline binary doubles, so nothing is formatted as text or written
+    // to disk
     void plot() {
         if (graphs.empty()) {
             std::cout << "No graphs to plot.\n";
             return;
         }
+        if (!hasEnabledData()) {
+            std::cout << "No enabled graphs to plot.\n";
+            return;
+        }
 
-        std::vector<std::string> tempFiles;
-        std::vector<std::string> plotCommands;
+        FILE* gp = popen("gnuplot -persist", "w");
+        if (!gp) {
+            std::cout << "Failed to start gnuplot.\n";
+            return;
+        }
+        writeSettings(gp);
+        writePlot(gp);
+        if (showStats) {
+            std::fputs("pause mouse close\n", gp);  // Keep plot open after displaying stats
+        }
+        pclose(gp);
+    }
 
-        // Generate data files
-        for (size_t i = 0; i < graphs.size(); ++i) {
-            if (!graphs[i].enabled) continue;
+    // Live plotting: opens a gnuplot window that refresh() redraws at most
+    // refreshHz times per second while a run appends points, so the cost
+    // per sample stays one clock read however fast samples arrive
+    void startLive(double refreshHz = 4) {
+        if (livePipe) return;
+        livePipe = popen("gnuplot -persist", "w");
+        if (!livePipe) {
+            std::cout << "Failed to start gnuplot, live plot disabled.\n";
+            return;
+        }
+        refreshInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / refreshHz));
+        lastRefresh = std::chrono::steady_clock::now();
+        writeSettings(livePipe);
+    }
 
-            std::string filename = "temp_graph_" + std::to_string(i) + ".dat";
-            tempFiles.push_back(filename);
+    // Redraws if the refresh interval has passed; true if it did
+    bool refresh() {
+        if (!livePipe) return false;
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastRefresh < refreshInterval) return false;
+        lastRefresh = now;
+        if (!hasEnabledData()) return false;
+        writePlot(livePipe);
+        std::fflush(livePipe);
+        return true;
+    }
 
+    // Final redraw; the window stays open after gnuplot's input is closed
+    void finishLive() {
+        if (!livePipe) return;
+        if (hasEnabledData()) writePlot(livePipe);
+        pclose(livePipe);
+        livePipe = nullptr;
+    }
 
-            std::ofstream outFile(filename);
-            for (const auto& point : graphs[i].data) {
-                outFile << point.first << " " << point.second << "\n";
+    // The points plot() sends for a series under the current settings
+    std::vector<std::pair<double, double>> downsample(const std::vector<std::pair<double, double>>& data) const {
+        if (downsampling == Downsampling::None || data.size() <= maxPoints) return data;
+        return downsampling == Downsampling::Lttb ? lttb(data, maxPoints) : minMax(data, maxPoints);
+    }
+
+private:
+    static_assert(sizeof(std::pair<double, double>) == 2 * sizeof(double), "binary record layout");
+
+    // Helper functions
+
+    bool hasEnabledData() const {
+        for (const auto& graph : graphs) {
+            if (graph.enabled && !graph.data.empty()) return true;
+        }
+        return false;
+    }
+
+    void writeSettings(FILE* gp) const {
+        std::ostringstream script;
+        script << "set terminal qt size 1000,700 enhanced font 'Verdana,12'\n"
+               << "set title " << quote(title) << "\n"
+               << "set xlabel " << quote(xLabel) << "\n"
+               << "set ylabel " << quote(yLabel) << "\n";
+        if (logX) script << "set logscale x\n";
+        if (logY) script << "set logscale y\n";
+        if (gridEnabled) script << "set grid\n";
+        script << "set key outside right top\n";
+        const std::string text = script.str();
+        std::fwrite(text.data(), 1, text.size(), gp);
+    }
+
+    // One plot command for the enabled graphs, followed by their points
+    void writePlot(FILE* gp) const {
+        std::vector<std::vector<std::pair<double, double>>> reduced;
+        reduced.reserve(graphs.size());  // series points into it
+        std::vector<std::pair<const std::pair<double, double>*, size_t>> series;
+        std::vector<std::string> plotCommands;
+        for (const auto& graph : graphs) {
+            if (!graph.enabled || graph.data.empty()) continue;
+
+            // A wrapped ring is rotated into order; a plain series is sent as
+            // it is unless it needs downsampling
+            const bool wrapped = graph.capacity && graph.head != 0;
+            if (wrapped || (downsampling != Downsampling::None && graph.data.size() > maxPoints)) {
+                std::vector<std::pair<double, double>> ordered;
+                if (wrapped) {
+                    ordered.reserve(graph.data.size());
+                    ordered.insert(ordered.end(), graph.data.begin() + graph.head, graph.data.end());
+                    ordered.insert(ordered.end(), graph.data.begin(), graph.data.begin() + graph.head);
+                }
+                reduced.push_back(downsample(wrapped ? ordered : graph.data));
+                series.emplace_back(reduced.back().data(), reduced.back().size());
+            } else {
+                series.emplace_back(graph.data.data(), graph.data.size());
             }
-            outFile.close();
 
-            // Build plot command for this graph
-            std::string command = "'" + filename + "' title '" + graphs[i].name + "' with " + graphs[i].lineStyle;
-            if (!graphs[i].color.empty()) {
-                command += " linecolor rgb '" + graphs[i].color + "'";
+            std::string command = "'-' binary record=" + std::to_string(series.back().second) +
+                                  " format='%float64%float64' using 1:2 title " + quote(graph.name) +
+                                  " with " + graph.lineStyle;
+            if (!graph.color.empty()) {
+                command += " linecolor rgb " + quote(graph.color);
             }
             plotCommands.push_back(command);
         }
 
-        if (plotCommands.empty()) {
-            std::cout << "No enabled graphs to plot.\n";
-            return;
+        const std::string text = "plot " + joinStrings(plotCommands, ", ") + "\n";
+        std::fwrite(text.data(), 1, text.size(), gp);
+        // std::pair<double, double> is two packed doubles, the record format
+        for (const auto& [points, count] : series) {
+            std::fwrite(points, sizeof(points[0]), count, gp);
         }
+    }
 
-        // Generate gnuplot script
-        std::ofstream gp("plot_commands.gp");
-        gp << "set terminal qt size 1000,700 enhanced font 'Verdana,12'\n";
-        gp << "set title '" << title << "'\n";
-        gp << "set xlabel '" << xLabel << "'\n";
-        gp << "set ylabel '" << yLabel << "'\n";
-        
-        if (logX) gp << "set logscale x\n";
-        if (logY) gp << "set logscale y\n";
-        if (gridEnabled) gp << "set grid\n";
-        
-        gp << "set key outside right top\n";
-        gp << "plot " << joinStrings(plotCommands, ", ") << "\n";
-        
-        if (showStats) {
-            gp << "pause mouse close\n";  // Keep plot open after displaying stats
+    // gnuplot single-quoted string; a quote inside is doubled
+    static std::string quote(const std::string& text) {
+        std::string result = "'";
+        for (char c : text) {
+            result += c;
+            if (c == '\'') result += '\'';
         }
-        gp.close();
+        return result + "'";
+    }
+
+    // Lowest and highest point of each of points/2 buckets, in their original order
+    static std::vector<std::pair<double, double>> minMax(const std::vector<std::pair<double, double>>& data,
+                                                         size_t points) {
+        const size_t buckets = points / 2;
+        std::vector<std::pair<double, double>> result;
+        result.reserve(2 * buckets);
+        for (size_t b = 0; b < buckets; ++b) {
+            const size_t begin = b * data.size() / buckets;
+            const size_t end = (b + 1) * data.size() / buckets;
+            size_t lo = begin, hi = begin;
+            for (size_t i = begin + 1; i < end; ++i) {
+                if (data[i].second < data[lo].second) lo = i;
+                if (data[i].second > data[hi].second) hi = i;
+            }
+            result.push_back(data[std::min(lo, hi)]);
+            if (lo != hi) result.push_back(data[std::max(lo, hi)]);
+        }
+        return result;
+    }
 
-        // Execute gnuplot
-        std::system("gnuplot -persist plot_commands.gp");
+    // Largest triangle three buckets (Steinarsson 2013): first and last point
+    // kept, then per bucket the point forming the largest triangle with the
+    // previously chosen point and the average of the next bucket
+    static std::vector<std::pair<double, double>> lttb(const std::vector<std::pair<double, double>>& data,
+                                                       size_t points) {
+        const size_t n = data.size();
+        const double bucket = static_cast<double>(n - 2) / (points - 2);
+        std::vector<std::pair<double, double>> result;
+        result.reserve(points);
+        result.push_back(data.front());
 
-        // Cleanup temp files
-        for (const auto& file : tempFiles) {
-            std::remove(file.c_str());
+        size_t previous = 0;
+        for (size_t b = 0; b < points - 2; ++b) {
+            const size_t begin = static_cast<size_t>(b * bucket) + 1;
+            const size_t end = static_cast<size_t>((b + 1) * bucket) + 1;
+            const size_t next_begin = end;
+            const size_t next_end = std::min(static_cast<size_t>((b + 2) * bucket) + 1, n);
+
+            double avg_x = 0, avg_y = 0;
+            for (size_t i = next_begin; i < next_end; ++i) {
+                avg_x += data[i].first;
+                avg_y += data[i].second;
+            }
+            const size_t next_count = next_end - next_begin;
+            if (next_count) {
+                avg_x /= next_count;
+                avg_y /= next_count;
+            } else {
+                avg_x = data.back().first;
+                avg_y = data.back().second;
+            }
+
+            const auto& a = data[previous];
+            size_t chosen = begin;
+            double best = -1;
+            for (size_t i = begin; i < end; ++i) {
+                const double area = std::abs((a.first - avg_x) * (data[i].second - a.second) -
+                                             (a.first - data[i].first) * (avg_y - a.second));
+                if (area > best) {
+                    best = area;
+                    chosen = i;
+                }
+            }
+            result.push_back(data[chosen]);
+            previous = chosen;
         }
+
+        result.push_back(data.back());
+        return result;
     }
 
-private:
-    // Helper functions
-    std::string joinStrings(const std::vector<std::string>& strings, const std::string& delimiter) {
+    static std::string joinStrings(const std::vector<std::string>& strings, const std::string& delimiter) {
         std::string result;
         for (size_t i = 0; i < strings.size(); ++i) {
             if (i != 0) result += delimiter;
@@ -177,28 +510,31 @@ private:
         return result;
     }
 
+    // Live graphs keep their statistics current on append(); a plain series
+    // is scanned once, the first time it is shown
     void showGraphStatistics() {
         std::cout << "\nGraph Statistics:\n";
         for (size_t i = 0; i < graphs.size(); ++i) {
-            if (!graphs[i].enabled) continue;
-            
-            const auto& data = graphs[i].data;
-            if (data.empty()) continue;
-
-            double minY = data[0].second, maxY = data[0].second;
-            double sumY = 0;
-            for (const auto& point : data) {
-                minY = std::min(minY, point.second);
-                maxY = std::max(maxY, point.second);
-                sumY += point.second;
+            Graph& graph = graphs[i];
+            if (!graph.enabled || graph.data.empty()) continue;
+
+            if (!graph.statsValid) {
+                for (const auto& point : graph.data) graph.stats.add(point.second);
+                graph.statsValid = true;
             }
-            double avgY = sumY / data.size();
+            const SeriesStats& stats = graph.stats;
+            const auto& first = graph.data[graph.capacity ? graph.head : 0];
+            const auto& last = graph.data[graph.capacity ? (graph.head + graph.data.size() - 1) % graph.data.size()
+                                                         : graph.data.size() - 1];
 
-            std::cout << "Graph " << i << " (" << graphs[i].name << "):\n"
-                      << "  Points: " << data.size() << "\n"
-                      << "  X Range: [" << data.front().first << ", " << data.back().first << "]\n"
-                      << "  Y Range: [" << minY << ", " << maxY << "]\n"
-                      << "  Y Average: " << avgY << "\n\n";
+            std::cout << "Graph " << i << " (" << graph.name << "):\n"
+                      << "  Points: " << stats.count;
+            if (graph.capacity) std::cout << " (last " << graph.data.size() << " shown)";
+            std::cout << "\n"
+                      << "  X Range: [" << first.first << ", " << last.first << "]\n"
+                      << "  Y Range: [" << stats.min << ", " << stats.max << "]\n"
+                      << "  Y Average: " << stats.mean << " (stddev " << std::sqrt(stats.variance()) << ")\n"
+                      << "  Y Median: ~" << stats.p50.value() << ", p99: ~" << stats.p99.value() << "\n\n";
         }
     }
 
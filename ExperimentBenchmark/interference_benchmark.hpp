@@ -0,0 +1,133 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include "source_factory.hpp"
+#include "graph_plotter.hpp"
+#include "latency_histogram.hpp"
+#include "load_generator.hpp"
+#include "precision_clock.hpp"
+#include "size_units.hpp"
+
+// Measures one source at increasing background load: level 0 is the idle
+// machine, level L runs L times the stressor threads of the spec. The
+// result is how far each latency percentile moves as the host gets busier;
+// a busy-waiting hook (the kprobe demo's spinning delay) shows up as tail growth
+// once the stressors compete for its CPU.
+class InterferenceBenchmark {
+public:
+    struct LevelResult {
+        size_t level = 0;
+        size_t stressor_threads = 0;
+        LatencyHistogram histogram;  // ns
+        std::vector<std::pair<StressKind, double>> load;
+    };
+
+    InterferenceBenchmark(std::string source, size_t num_experiments, size_t chunk_size,
+                          std::vector<StressSpec> specs, size_t max_level, const SourceSettings& settings = {})
+        : source_name_(std::move(source)),
+          NUM_EXPERIMENTS(num_experiments),
+          CHUNK_SIZE(chunk_size),
+          MAX_LEVEL(max_level),
+          specs_(std::move(specs)),
+          source_(make_entropy_source(source_name_, settings)),
+          buffer_(chunk_size) {}
+
+    void use_clock(const PrecisionClock& clock) { clock_ = &clock; }
+
+    void run() {
+        std::cout << "Starting " << source_name_ << " interference run: " << NUM_EXPERIMENTS << " reads of "
+                  << format_size(CHUNK_SIZE) << " at load levels 0.." << MAX_LEVEL << "\n";
+
+        for (size_t level = 0; level <= MAX_LEVEL; ++level) {
+            levels_.push_back(measure(level));
+            print_level(levels_.back());
+        }
+
+        analyze_results();
+    }
+
+    const std::string& source_name() const { return source_name_; }
+    const std::vector<LevelResult>& levels() const { return levels_; }
+
+    // Percentile latency in µs against the number of stressor threads
+    void add_percentile_graph(GraphPlotter& plotter, const std::string& label, double percentile) const {
+        std::vector<std::pair<double, double>> curve;
+        for (const auto& r : levels_) {
+            curve.emplace_back(r.stressor_threads, r.histogram.value_at_percentile(percentile) / 1e3);
+        }
+        plotter.addGraph(source_name_ + " " + label, std::move(curve));
+    }
+
+private:
+    const std::string source_name_;
+    const size_t NUM_EXPERIMENTS;
+    const size_t CHUNK_SIZE;
+    const size_t MAX_LEVEL;
+    const std::vector<StressSpec> specs_;
+    std::unique_ptr<EntropySource> source_;
+    std::vector<char> buffer_;
+    const PrecisionClock* clock_ = &PrecisionClock::instance();
+    std::vector<LevelResult> levels_;
+
+    LevelResult measure(size_t level) {
+        LevelResult result;
+        result.level = level;
+
+        LoadGenerator load(specs_, level);
+        result.stressor_threads = load.threads();
+        load.start();
+
+        source_->fill(buffer_.data(), CHUNK_SIZE);  // untimed: settle after the load started
+        for (size_t i = 0; i < NUM_EXPERIMENTS; ++i) {
+            const uint64_t start = clock_->start();
+            source_->fill(buffer_.data(), CHUNK_SIZE);
+            const uint64_t end = clock_->stop();
+            result.histogram.record(clock_->elapsed_ns(start, end));
+        }
+
+        load.stop();
+        result.load = load.rates();
+        return result;
+    }
+
+    void print_level(const LevelResult& r) const {
+        std::cout << "Level " << r.level << " (" << r.stressor_threads << " stressor threads): avg "
+                  << r.histogram.mean() / 1e3 << " µs, p99 " << r.histogram.value_at_percentile(99) / 1e3 << " µs";
+        for (const auto& [kind, rate] : r.load) {
+            std::cout << ", " << stress_kind_names()[static_cast<size_t>(kind)] << " " << rate << " "
+                      << stress_unit(kind);
+        }
+        std::cout << "\n";
+    }
+
+    // Each percentile as an absolute value and as a multiple of the idle run
+    void analyze_results() const {
+        const auto& idle = levels_.front().histogram;
+        std::cout << "\n=== Interference Results (" << source_name_ << ", µs) ===\n"
+                  << std::setw(6) << "Level" << std::setw(9) << "Threads";
+        for (const auto& [label, percentile] : report_percentiles()) {
+            std::cout << std::setw(20) << label;
+        }
+        std::cout << std::setw(12) << "MB/s" << "\n";
+
+        for (const auto& r : levels_) {
+            std::cout << std::setw(6) << r.level << std::setw(9) << r.stressor_threads;
+            for (const auto& [label, percentile] : report_percentiles()) {
+                const double value = r.histogram.value_at_percentile(percentile) / 1e3;
+                const double base = idle.value_at_percentile(percentile) / 1e3;
+                std::ostringstream cell;
+                cell << std::fixed << std::setprecision(2) << value;
+                if (r.level > 0 && base > 0) cell << " (x" << std::setprecision(1) << value / base << ")";
+                std::cout << std::setw(20) << cell.str();
+            }
+            const double mean_s = r.histogram.mean() / 1e9;
+            std::cout << std::setw(12) << std::fixed << std::setprecision(2)
+                      << (mean_s > 0 ? CHUNK_SIZE / mean_s / 1e6 : 0) << std::defaultfloat << "\n";
+        }
+    }
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "entropy_source.hpp"
+#include "latency_histogram.hpp"
+
+// Asynchronous /dev/urandom reader on a raw io_uring (no liburing needed).
+// QUEUE_DEPTH reads of one slot each are kept in flight into registered
+// fixed buffers; fill() hands out completed slots and re-queues them, and
+// re-queued reads are pushed to the kernel BATCH_SIZE at a time, so one
+// io_uring_enter() covers many small requests. With SQPOLL a kernel thread
+// picks up submissions and the steady state needs no syscall at all.
+class IoUringSource : public EntropySource {
+public:
+    static constexpr size_t MAX_SLOT_SIZE = 1024 * 1024;
+
+    IoUringSource(std::string label, unsigned queue_depth, unsigned batch_size, bool sqpoll)
+        : label_(std::move(label)),
+          QUEUE_DEPTH(std::max(1u, queue_depth)),
+          BATCH_SIZE(std::clamp(batch_size, 1u, QUEUE_DEPTH)),
+          SQPOLL(sqpoll) {
+        file_fd_ = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+        if (file_fd_ < 0) {
+            throw std::runtime_error(std::string("Failed to open /dev/urandom: ") + std::strerror(errno));
+        }
+        try {
+            setup_ring();
+        } catch (...) {
+            teardown();
+            throw;
+        }
+    }
+
+    ~IoUringSource() override {
+        teardown();
+    }
+
+    IoUringSource(const IoUringSource&) = delete;
+    IoUringSource& operator=(const IoUringSource&) = delete;
+
+    std::string name() const override { return label_; }
+
+    void fill(char* buf, size_t len) override {
+        const size_t wanted_slot = std::min(len, MAX_SLOT_SIZE);
+        if (wanted_slot != slot_size_) {
+            configure_slots(wanted_slot);
+        }
+
+        size_t done = 0;
+        while (done < len) {
+            if (ready_.empty()) {
+                reap(true);
+            }
+            Ready& current = ready_.front();
+            const size_t part = std::min(len - done, current.length - current.offset);
+            std::memcpy(buf + done, slot_data(current.slot) + current.offset, part);
+            current.offset += part;
+            done += part;
+
+            if (current.offset == current.length) {
+                queue_read(current.slot);
+                ready_.pop_front();
+            }
+        }
+        if (unsubmitted_ >= BATCH_SIZE) {
+            submit();
+        }
+    }
+
+    std::vector<std::pair<std::string, const LatencyHistogram*>> extra_latencies() const override {
+        return {{"Submit-to-completion", &completion_latency_}};
+    }
+
+private:
+    struct Ready {
+        unsigned slot;
+        size_t length;
+        size_t offset;
+    };
+
+    const std::string label_;
+    const unsigned QUEUE_DEPTH;
+    const unsigned BATCH_SIZE;
+    const bool SQPOLL;
+
+    int file_fd_ = -1;
+    int ring_fd_ = -1;
+    io_uring_params params_{};
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_flags_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    char* slots_ = nullptr;
+    size_t slot_size_ = 0;
+    bool buffers_registered_ = false;
+    // When each slot's read reached the kernel: the io_uring_enter() that
+    // submitted it, or with SQPOLL the tail store the poller picks up. Reads
+    // waiting for a batch to fill are not yet submitted, so that wait is
+    // not part of the completion latency.
+    std::vector<std::chrono::steady_clock::time_point> submitted_at_;
+    std::vector<unsigned> unsubmitted_slots_;
+    std::deque<Ready> ready_;
+    unsigned in_flight_ = 0;
+    unsigned unsubmitted_ = 0;
+    LatencyHistogram completion_latency_;
+
+    static int io_uring_setup(unsigned entries, io_uring_params* p) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    static int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    static void* map_ring(int fd, size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        if (ptr == MAP_FAILED) {
+            throw std::runtime_error(std::string("Failed to map io_uring ring: ") + std::strerror(errno));
+        }
+        return ptr;
+    }
+
+    void setup_ring() {
+        if (SQPOLL) {
+            params_.flags |= IORING_SETUP_SQPOLL;
+            params_.sq_thread_idle = 1000;  // ms before the poller sleeps
+        }
+        ring_fd_ = io_uring_setup(QUEUE_DEPTH, &params_);
+        if (ring_fd_ < 0) {
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+        }
+
+        sq_ring_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+        if (params_.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = map_ring(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = (params_.features & IORING_FEAT_SINGLE_MMAP)
+                       ? sq_ring_
+                       : map_ring(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params_.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map_ring(ring_fd_, sqes_size_, IORING_OFF_SQES));
+
+        auto* sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+        sq_flags_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.flags);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+
+        auto* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+
+        // Older kernels only let SQPOLL use registered files
+        if (io_uring_register(ring_fd_, IORING_REGISTER_FILES, &file_fd_, 1) < 0) {
+            throw std::runtime_error(std::string("io_uring file registration failed: ") + std::strerror(errno));
+        }
+        submitted_at_.resize(QUEUE_DEPTH);
+        unsubmitted_slots_.reserve(QUEUE_DEPTH);
+    }
+
+    char* slot_data(unsigned slot) const {
+        return slots_ + static_cast<size_t>(slot) * slot_size_;
+    }
+
+    // (Re)allocates and registers QUEUE_DEPTH slots of `size` bytes and puts
+    // them all in flight. Outstanding reads are drained first because their
+    // buffers are about to go away.
+    void configure_slots(size_t size) {
+        while (in_flight_ > 0) {
+            reap(true);
+        }
+        ready_.clear();
+        release_slots();
+
+        slot_size_ = size;
+        const size_t total = slot_size_ * QUEUE_DEPTH;
+        void* mem = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (mem == MAP_FAILED) {
+            throw std::runtime_error(std::string("Failed to allocate io_uring buffers: ") + std::strerror(errno));
+        }
+        slots_ = static_cast<char*>(mem);
+
+        std::vector<iovec> iovecs(QUEUE_DEPTH);
+        for (unsigned i = 0; i < QUEUE_DEPTH; ++i) {
+            iovecs[i] = {slot_data(i), slot_size_};
+        }
+        // Registration pins the pages and can fail on a low RLIMIT_MEMLOCK;
+        // plain READ into the same buffers still works, just without the
+        // fixed-buffer saving.
+        buffers_registered_ = io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS, iovecs.data(), QUEUE_DEPTH) == 0;
+
+        for (unsigned i = 0; i < QUEUE_DEPTH; ++i) {
+            queue_read(i);
+        }
+        submit();
+    }
+
+    void release_slots() {
+        if (!slots_) return;
+        if (buffers_registered_) {
+            io_uring_register(ring_fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            buffers_registered_ = false;
+        }
+        munmap(slots_, slot_size_ * QUEUE_DEPTH);
+        slots_ = nullptr;
+    }
+
+    void queue_read(unsigned slot) {
+        const unsigned tail = *sq_tail_;
+        const unsigned index = tail & *sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = buffers_registered_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = 0;  // index into the registered file table
+        sqe->addr = reinterpret_cast<uint64_t>(slot_data(slot));
+        sqe->len = static_cast<uint32_t>(slot_size_);
+        sqe->off = 0;
+        sqe->buf_index = static_cast<uint16_t>(slot);
+        sqe->user_data = slot;
+        sq_array_[index] = index;
+
+        if (SQPOLL) {
+            submitted_at_[slot] = std::chrono::steady_clock::now();
+        } else {
+            unsubmitted_slots_.push_back(slot);
+        }
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++in_flight_;
+        ++unsubmitted_;
+    }
+
+    void submit() {
+        if (unsubmitted_ == 0) return;
+        if (SQPOLL) {
+            // The tail store above is all the poller needs unless it slept;
+            // the fence orders that store against reading the wakeup flag
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(sq_flags_, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) {
+                io_uring_enter(ring_fd_, 0, 0, IORING_ENTER_SQ_WAKEUP);
+            }
+        } else {
+            const auto now = std::chrono::steady_clock::now();
+            for (unsigned slot : unsubmitted_slots_) {
+                submitted_at_[slot] = now;
+            }
+            unsubmitted_slots_.clear();
+            while (unsubmitted_ > 0) {
+                int ret = io_uring_enter(ring_fd_, unsubmitted_, 0, 0);
+                if (ret < 0) {
+                    if (errno == EINTR) continue;
+                    throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+                }
+                unsubmitted_ -= static_cast<unsigned>(ret);
+            }
+        }
+        unsubmitted_ = 0;
+    }
+
+    // Moves every available completion to ready_; with wait=true blocks
+    // until at least one is available.
+    void reap(bool wait) {
+        unsigned head = *cq_head_;
+        while (wait && head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+            submit();
+            int ret = io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+            if (ret < 0 && errno != EINTR) {
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            const auto slot = static_cast<unsigned>(cqe.user_data);
+            --in_flight_;
+            if (cqe.res <= 0) {
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                throw std::runtime_error(std::string("io_uring read failed: ") +
+                                         (cqe.res < 0 ? std::strerror(-cqe.res) : "end of file"));
+            }
+            completion_latency_.record(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - submitted_at_[slot]).count());
+            ready_.push_back({slot, static_cast<size_t>(cqe.res), 0});
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    void teardown() {
+        // Let outstanding reads land before their buffers go away
+        try {
+            while (in_flight_ > 0 && ring_fd_ >= 0) {
+                reap(true);
+            }
+        } catch (const std::exception&) {
+        }
+        release_slots();
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+        sqes_ = nullptr;
+        cq_ring_ = sq_ring_ = nullptr;
+        // Closing the ring cancels whatever is still in flight
+        if (ring_fd_ >= 0) close(ring_fd_);
+        if (file_fd_ >= 0) close(file_fd_);
+        ring_fd_ = file_fd_ = -1;
+    }
+};
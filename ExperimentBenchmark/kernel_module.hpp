@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Loading and unloading of the hook modules straight through
+// finit_module(2)/delete_module(2), so toggling a hook between benchmark
+// blocks costs a syscall and not a sudo/insmod fork. Needs CAP_SYS_MODULE.
+// Both calls return only once /sys/module shows the new state.
+//
+// The kernel loads a module with unknown parameters and only warns about
+// them in dmesg; a load therefore fails unless every parameter it was given
+// shows up in /sys/module/<name>/parameters, so an older build of a hook
+// cannot silently stand in for the configuration asked for.
+
+constexpr int MODULE_STATE_TIMEOUT_MS = 5000;
+
+// What a failed module syscall most likely means
+inline const char* kernel_module_error_hint(int err) {
+    switch (err) {
+        case EPERM: return "needs root (CAP_SYS_MODULE)";
+        case EEXIST: return "already loaded";
+        case ENOENT: return "no such module or module file";
+        case EBUSY:
+        case EWOULDBLOCK: return "module is in use";
+        case ENOEXEC: return "not a module for this kernel";
+        case EINVAL: return "bad parameter or module, see dmesg";
+        case ETIMEDOUT: return "state did not change in /sys/module";
+        default: return std::strerror(err);
+    }
+}
+
+// A failed load or unload; error() is the errno behind it
+class KernelModuleError : public std::runtime_error {
+public:
+    KernelModuleError(const std::string& action, int error)
+        : KernelModuleError(action, error, kernel_module_error_hint(error)) {}
+
+    KernelModuleError(const std::string& action, int error, const std::string& reason)
+        : std::runtime_error(action + " failed: " + reason), error_(error) {}
+
+    int error() const { return error_; }
+
+private:
+    int error_;
+};
+
+// "../modules/kprobe_override.ko" -> "kprobe_override"
+inline std::string module_name_from_path(const std::string& path) {
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, ".ko") == 0) {
+        name.resize(name.size() - 3);
+    }
+    for (auto& c : name) {
+        if (c == '-') c = '_';
+    }
+    return name;
+}
+
+// A name is looked up as <dir>/<name>.ko; anything with a '/' is a path
+inline std::string module_path(const std::string& dir, const std::string& module) {
+    return module.find('/') == std::string::npos ? dir + module + ".ko" : module;
+}
+
+inline bool is_kernel_module_loaded(const std::string& name) {
+    return access(("/sys/module/" + name).c_str(), F_OK) == 0;
+}
+
+// Polls /sys/module every millisecond; false if the module did not reach
+// the state within the timeout
+inline bool wait_for_module_state(const std::string& name, bool loaded,
+                                  int timeout_ms = MODULE_STATE_TIMEOUT_MS) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (is_kernel_module_loaded(name) != loaded) {
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// First parameter in an insmod-style list that the loaded module does not
+// have, empty if all of them exist. The kernel accepts '-' for '_' in
+// parameter names.
+inline std::string missing_module_parameter(const std::string& name, const std::string& params) {
+    const std::string dir = "/sys/module/" + name + "/parameters/";
+    size_t pos = 0;
+    while ((pos = params.find_first_not_of(' ', pos)) != std::string::npos) {
+        const size_t end = std::min(params.find(' ', pos), params.size());
+        std::string key = params.substr(pos, std::min(params.find('=', pos), end) - pos);
+        for (auto& c : key) {
+            if (c == '-') c = '_';
+        }
+        if (access((dir + key).c_str(), F_OK) != 0) return key;
+        pos = end;
+    }
+    return "";
+}
+
+inline void unload_kernel_module(const std::string& name) {
+    if (syscall(SYS_delete_module, name.c_str(), O_NONBLOCK) != 0) {
+        throw KernelModuleError("delete_module(" + name + ")", errno);
+    }
+    if (!wait_for_module_state(name, false)) {
+        throw KernelModuleError("Unloading " + name, ETIMEDOUT);
+    }
+}
+
+// params as on an insmod command line: "delay_us=200 delay_mode=uniform"
+inline void load_kernel_module(const std::string& path, const std::string& params = "") {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw KernelModuleError("Opening module " + path, errno);
+    }
+    long ret = syscall(SYS_finit_module, fd, params.c_str(), 0);
+    int err = errno;
+    close(fd);
+    if (ret != 0) {
+        throw KernelModuleError("finit_module(" + path + ")", err);
+    }
+    // finit_module returns once init ran; the sysfs entry may lag behind
+    const std::string name = module_name_from_path(path);
+    if (!wait_for_module_state(name, true)) {
+        throw KernelModuleError("Loading " + path, ETIMEDOUT);
+    }
+
+    const std::string missing = missing_module_parameter(name, params);
+    if (!missing.empty()) {
+        try {
+            unload_kernel_module(name);
+        } catch (const KernelModuleError&) {
+            // The parameter error is the one worth reporting
+        }
+        throw KernelModuleError("Loading " + path, EINVAL,
+                                "module has no parameter '" + missing + "' (built before it existed?)");
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// Constant-memory log-linear histogram in the style of HdrHistogram. Values
+// below 256 get an exact bucket each; above that every power of two is split
+// into 128 linear sub-buckets, so any recorded value is reproduced within
+// 1/128 (< 0.8%) over the whole uint64_t range in ~58 KB of counters.
+// Histograms with the same layout merge by adding counters, which makes
+// per-thread recording and cross-run aggregation exact.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 8;
+    static constexpr uint64_t SUB_BUCKET_HALF = 1ULL << (SUB_BUCKET_BITS - 1);
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_HALF + SUB_BUCKET_HALF;
+
+    LatencyHistogram() : counts_(BUCKET_COUNT, 0) {}
+
+    void record(uint64_t value, uint64_t count = 1) {
+        counts_[bucket_index(value)] += count;
+        total_ += count;
+        sum_ += static_cast<long double>(value) * count;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        total_ = 0;
+        sum_ = 0;
+        min_ = std::numeric_limits<uint64_t>::max();
+        max_ = 0;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? static_cast<double>(sum_ / total_) : 0.0; }
+    long double sum() const { return sum_; }
+
+    // Adds `count` samples straight into a bucket; used when reloading a
+    // saved histogram, followed by restore_totals() for the exact extremes.
+    void record_bucket(size_t index, uint64_t count) {
+        counts_.at(index) += count;
+        total_ += count;
+    }
+
+    void restore_totals(uint64_t min, uint64_t max, long double sum) {
+        min_ = min;
+        max_ = max;
+        sum_ = sum;
+    }
+
+    // Smallest recorded value v such that `percentile` percent of all
+    // samples are <= v, reported as the upper edge of its bucket (clamped
+    // to the true extremes so p0/p100 are exact).
+    uint64_t value_at_percentile(double percentile) const {
+        if (total_ == 0) return 0;
+        percentile = std::clamp(percentile, 0.0, 100.0);
+        uint64_t target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total_));
+        target = std::max<uint64_t>(target, 1);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += counts_[i];
+            if (seen >= target) {
+                return std::clamp(bucket_upper(i), min_, max_);
+            }
+        }
+        return max_;
+    }
+
+    // (percentile, value) pairs for a latency-by-percentile plot; x grows
+    // logarithmically towards 100 so the tail gets as much room as the body
+    std::vector<std::pair<double, double>> percentile_curve(double scale = 1.0) const {
+        std::vector<std::pair<double, double>> points;
+        if (total_ == 0) return points;
+        for (double nines = 0; nines <= 6.0; nines += 0.05) {
+            double percentile = 100.0 * (1.0 - std::pow(10.0, -nines));
+            points.emplace_back(nines, value_at_percentile(percentile) * scale);
+        }
+        return points;
+    }
+
+    const std::vector<uint64_t>& counts() const { return counts_; }
+
+    static size_t bucket_index(uint64_t value) {
+        if (value < (SUB_BUCKET_HALF << 1)) return static_cast<size_t>(value);
+        const int msb = 63 - __builtin_clzll(value);
+        const int shift = msb - (SUB_BUCKET_BITS - 1);
+        return static_cast<size_t>(shift) * SUB_BUCKET_HALF + (value >> shift);
+    }
+
+    static uint64_t bucket_lower(size_t index) {
+        if (index < (SUB_BUCKET_HALF << 1)) return index;
+        const int shift = static_cast<int>(index / SUB_BUCKET_HALF) - 1;
+        const uint64_t top = index - static_cast<uint64_t>(shift) * SUB_BUCKET_HALF;
+        return top << shift;
+    }
+
+    static uint64_t bucket_upper(size_t index) {
+        if (index + 1 >= BUCKET_COUNT) return std::numeric_limits<uint64_t>::max();
+        return bucket_lower(index + 1) - 1;
+    }
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    long double sum_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+};
+
+// The percentiles every latency report prints
+inline const std::vector<std::pair<std::string, double>>& report_percentiles() {
+    static const std::vector<std::pair<std::string, double>> percentiles = {
+        {"p50", 50.0}, {"p90", 90.0}, {"p99", 99.0}, {"p99.9", 99.9}, {"p99.99", 99.99},
+    };
+    return percentiles;
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <sys/syscall.h>
+#include "benchmark_buffer.hpp"
+#include "size_units.hpp"
+
+// Background stressor threads that run while the RNG is measured:
+//
+//   cpu      integer spin loop, competes for the core
+//   mem      streaming copy between two buffers of 2x the LLC, at most 256 MB
+//            each (bandwidth)
+//   io       pwrite/pread of a 64 MB unlinked temp file (page-cache traffic)
+//   syscall  getppid() storm (entry/exit, mitigations, scheduler ticks)
+//   rng      other getrandom() readers (crng contention)
+//
+// Each stressor counts the work it did, so a report can show how much load
+// was actually applied and not only how many threads were started.
+enum class StressKind { Cpu, Memory, Io, Syscall, Rng };
+
+struct StressSpec {
+    StressKind kind;
+    size_t threads;
+};
+
+inline const std::vector<std::string>& stress_kind_names() {
+    static const std::vector<std::string> names = {"cpu", "mem", "io", "syscall", "rng"};
+    return names;
+}
+
+inline const char* stress_unit(StressKind kind) {
+    switch (kind) {
+        case StressKind::Cpu: return "Mloop/s";
+        case StressKind::Memory: return "MB/s";
+        case StressKind::Io: return "MB/s";
+        case StressKind::Syscall: return "Mcall/s";
+        default: return "MB/s";
+    }
+}
+
+// "cpu:2,mem:1,io" (a kind without a count means one thread) or "all"
+inline std::vector<StressSpec> parse_stress_spec(const std::string& text) {
+    const auto& names = stress_kind_names();
+    std::vector<StressSpec> specs;
+    if (text == "all") {
+        for (size_t i = 0; i < names.size(); ++i) specs.push_back({static_cast<StressKind>(i), 1});
+        return specs;
+    }
+
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) end = text.size();
+        const std::string item = text.substr(begin, end - begin);
+        begin = end + 1;
+        if (item.empty()) continue;
+
+        const auto colon = item.find(':');
+        const std::string name = item.substr(0, colon);
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it == names.end()) {
+            throw std::invalid_argument("Unknown load kind: " + name);
+        }
+        const size_t threads = colon == std::string::npos ? 1 : std::stoul(item.substr(colon + 1));
+        specs.push_back({static_cast<StressKind>(it - names.begin()), threads});
+    }
+    if (specs.empty()) {
+        throw std::invalid_argument("Empty load specification");
+    }
+    return specs;
+}
+
+class LoadGenerator {
+public:
+    struct Stressor {
+        StressKind kind;
+        std::atomic<uint64_t> work{0};  // loops, bytes or calls, see stress_unit()
+    };
+
+    // Every spec's thread count is multiplied by `level`; level 0 starts nothing
+    LoadGenerator(const std::vector<StressSpec>& specs, size_t level) {
+        for (const auto& spec : specs) {
+            for (size_t i = 0; i < spec.threads * level; ++i) {
+                stressors_.push_back(std::make_unique<Stressor>());
+                stressors_.back()->kind = spec.kind;
+            }
+        }
+    }
+
+    ~LoadGenerator() {
+        stop();
+    }
+
+    LoadGenerator(const LoadGenerator&) = delete;
+    LoadGenerator& operator=(const LoadGenerator&) = delete;
+
+    void start() {
+        started_ = std::chrono::steady_clock::now();
+        for (auto& s : stressors_) {
+            Stressor* stressor = s.get();
+            threads_.emplace_back([this, stressor] { run_stressor(*stressor); });
+        }
+        // Buffers and the temp file are set up first; only then is the load
+        // real, so wait for every stressor and give them a moment to settle
+        if (stressors_.empty()) return;
+        while (ready_.load() < stressors_.size()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    void stop() {
+        if (threads_.empty()) return;
+        stopping_.store(true, std::memory_order_relaxed);
+        for (auto& t : threads_) t.join();
+        threads_.clear();
+        elapsed_s_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    }
+
+    size_t threads() const { return stressors_.size(); }
+
+    // Work per second of each kind, summed over its threads
+    std::vector<std::pair<StressKind, double>> rates() const {
+        std::vector<std::pair<StressKind, double>> result;
+        for (const auto& s : stressors_) {
+            auto it = std::find_if(result.begin(), result.end(), [&](const auto& r) { return r.first == s->kind; });
+            if (it == result.end()) {
+                result.emplace_back(s->kind, 0.0);
+                it = result.end() - 1;
+            }
+            it->second += elapsed_s_ > 0 ? s->work.load() / elapsed_s_ / 1e6 : 0;
+        }
+        return result;
+    }
+
+private:
+    std::vector<std::unique_ptr<Stressor>> stressors_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> ready_{0};
+    std::chrono::steady_clock::time_point started_;
+    double elapsed_s_ = 0;
+
+    bool running() const { return !stopping_.load(std::memory_order_relaxed); }
+
+    void run_stressor(Stressor& s) {
+        switch (s.kind) {
+            case StressKind::Cpu: spin(s); break;
+            case StressKind::Memory: stream(s); break;
+            case StressKind::Io: page_cache_io(s); break;
+            case StressKind::Syscall: syscall_storm(s); break;
+            case StressKind::Rng: rng_reader(s); break;
+        }
+    }
+
+    void spin(Stressor& s) {
+        uint64_t x = 88172645463325252ULL;
+        ready_.fetch_add(1);
+        while (running()) {
+            for (int i = 0; i < 4096; ++i) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+            }
+            s.work.fetch_add(4096, std::memory_order_relaxed);
+        }
+        volatile uint64_t sink = x;
+        (void)sink;
+    }
+
+    void stream(Stressor& s) {
+        const size_t size = std::min<size_t>(2 * last_level_cache_size(), 256 << 20);
+        std::vector<char> a(size, 1), b(size, 2);
+        ready_.fetch_add(1);
+        while (running()) {
+            for (size_t offset = 0; offset < size && running(); offset += 1 << 20) {
+                const size_t n = std::min<size_t>(1 << 20, size - offset);
+                std::memcpy(b.data() + offset, a.data() + offset, n);
+                s.work.fetch_add(2 * n, std::memory_order_relaxed);  // read + write
+            }
+            std::swap(a, b);
+        }
+    }
+
+    void page_cache_io(Stressor& s) {
+        constexpr size_t FILE_SIZE = 64 << 20;
+        constexpr size_t BLOCK = 1 << 20;
+        char path[] = "/tmp/rngbench-load-XXXXXX";
+        const int fd = mkstemp(path);
+        if (fd >= 0) unlink(path);
+
+        std::vector<char> block(BLOCK, 'x');
+        for (size_t offset = 0; fd >= 0 && offset < FILE_SIZE && running(); offset += BLOCK) {
+            if (pwrite(fd, block.data(), BLOCK, offset) < 0) break;
+        }
+        ready_.fetch_add(1);
+        if (fd < 0) return;
+        for (size_t i = 0; running(); ++i) {
+            const off_t offset = static_cast<off_t>((i * BLOCK) % FILE_SIZE);
+            // Every fourth block is rewritten so dirty pages keep flowing too
+            const ssize_t n = i % 4 == 0 ? pwrite(fd, block.data(), BLOCK, offset)
+                                         : pread(fd, block.data(), BLOCK, offset);
+            if (n < 0) break;
+            s.work.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        }
+        close(fd);
+    }
+
+    void syscall_storm(Stressor& s) {
+        ready_.fetch_add(1);
+        while (running()) {
+            for (int i = 0; i < 256; ++i) syscall(SYS_getppid);
+            s.work.fetch_add(256, std::memory_order_relaxed);
+        }
+    }
+
+    void rng_reader(Stressor& s) {
+        char buf[4096];
+        ready_.fetch_add(1);
+        while (running()) {
+            const ssize_t n = getrandom(buf, sizeof(buf), 0);
+            if (n < 0 && errno != EINTR) break;
+            if (n > 0) s.work.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        }
+    }
+};
@@ -1,94 +1,328 @@
 #include <iostream>
-#include <fstream>
+#include <iomanip>
 #include <vector>
-#include <chrono>
-#include <numeric>
 #include <stdexcept>
 #include "graph_plotter.hpp"
+#include "benchmark_options.hpp"
+#include "random_benchmark.hpp"
+#include "thread_scaling.hpp"
+#include "chunk_sweep.hpp"
+#include "interference_benchmark.hpp"
+#include "ab_comparison.hpp"
+#include "kernel_module.hpp"
+#include "result_store.hpp"
 
-class RandomBenchmark {
-public:
-    RandomBenchmark(size_t num_experiments, size_t chunk_size)
-        : NUM_EXPERIMENTS(num_experiments),
-          CHUNK_SIZE(chunk_size),
-          buffer_(chunk_size) {}
+static void print_comparison(const std::vector<RandomBenchmark>& benchmarks) {
+    std::cout << "\n=== Source Comparison (µs) ===\n"
+              << std::left << std::setw(30) << "Source" << std::right
+              << std::setw(12) << "Avg"
+              << std::setw(12) << "Min";
+    for (const auto& [label, percentile] : report_percentiles()) {
+        std::cout << std::setw(12) << label;
+    }
+    std::cout << std::setw(12) << "Max"
+              << std::setw(12) << "MB/s" << "\n";
 
-    void run() {
-        std::cout << "Starting benchmark with " << NUM_EXPERIMENTS 
-                  << " iterations of " << CHUNK_SIZE/(1024*1024) << "MB reads\n";
+    for (const auto& bench : benchmarks) {
+        const auto& h = bench.histogram();
+        const double avg = bench.average_time();
+        std::cout << std::left << std::setw(30) << bench.source_name() << std::right
+                  << std::setw(12) << avg
+                  << std::setw(12) << h.min() / 1e3;
+        for (const auto& [label, percentile] : report_percentiles()) {
+            std::cout << std::setw(12) << h.value_at_percentile(percentile) / 1e3;
+        }
+        std::cout << std::setw(12) << h.max() / 1e3
+                  << std::setw(12) << bench.chunk_size()/(avg/1e6)/1e6 << "\n";
+    }
+}
 
-        for (size_t i = 0; i < NUM_EXPERIMENTS; ++i) {
-            auto duration = run_single_iteration(i);
-            timings_.push_back(duration);
-            print_iteration_stats(i, duration);
+static void visualize_results(const std::vector<RandomBenchmark>& benchmarks, const BenchmarkOptions& opts) {
+    GraphPlotter plotter;
+    plotter.setDownsampling(parse_downsampling(opts.downsample), opts.plot_points);
+    plotter.setTitle("Random Read Performance");
+    if (benchmarks.front().timings().empty()) {
+        // Histogram-only runs have no per-iteration series to draw
+        plotter.setXLabel("Percentile (number of nines)");
+        plotter.setYLabel("Time (µs)");
+        plotter.setLogScale(false, true);
+        for (const auto& bench : benchmarks) {
+            plotter.addGraph(bench.source_name() + " Latency by Percentile", bench.histogram().percentile_curve(1e-3));
+        }
+    } else {
+        plotter.setXLabel("Iteration");
+        plotter.setYLabel("Time (µs)");
+        for (const auto& bench : benchmarks) {
+            plotter.addGraph(bench.source_name() + " Read Latency", bench.timings(), 1);
         }
+        for (const auto& bench : benchmarks) {
+            if (bench.outliers().empty()) continue;
+            std::vector<std::pair<double, double>> flagged;
+            for (size_t i : bench.outliers()) {
+                flagged.emplace_back(i + 1, bench.timings()[i]);
+            }
+            plotter.addGraph(bench.source_name() + " outliers", std::move(flagged));
+            plotter.setGraphStyle(plotter.graphCount() - 1, "points");
+        }
+    }
+    plotter.plot();
 
-        analyze_results();
-        visualize_results();
+    // Counter deltas per iteration, on the same x axis as the latency plot
+    GraphPlotter counters;
+    counters.setDownsampling(parse_downsampling(opts.downsample), opts.plot_points);
+    counters.setTitle("Perf Counters per Read");
+    counters.setXLabel("Iteration");
+    counters.setYLabel("Events per call");
+    counters.setLogScale(false, true);
+    for (const auto& bench : benchmarks) {
+        const PerfCounterLog* log = bench.perf_log();
+        if (!log || log->samples().empty()) continue;
+        for (size_t c = 0; c < PerfCounterGroup::COUNTER_COUNT; ++c) {
+            if (!log->supported(c)) continue;
+            std::vector<double> series;
+            series.reserve(log->samples().size());
+            for (const auto& values : log->samples()) {
+                series.push_back(static_cast<double>(values[c]));
+            }
+            counters.addGraph(bench.source_name() + " " + PerfCounterGroup::counter_name(c), series, 1);
+        }
+    }
+    if (counters.graphCount() > 0) {
+        counters.plot();
     }
+}
 
-private:
-    const size_t NUM_EXPERIMENTS;
-    const size_t CHUNK_SIZE;
-    std::vector<char> buffer_;
-    std::vector<double> timings_;
+static void run_scaling(const BenchmarkOptions& opts) {
+    std::vector<ThreadScalingBenchmark> benchmarks;
+    for (const auto& name : opts.sources) {
+        benchmarks.emplace_back(name, opts.num_experiments, opts.chunk_size, opts.threads, opts.source_settings);
+        if (opts.perf) benchmarks.back().enable_perf_counters();
+        benchmarks.back().use_clock(PrecisionClock::instance(opts.tsc));
+        benchmarks.back().run();
+    }
 
-    double run_single_iteration(size_t iteration) {
-        auto start = std::chrono::high_resolution_clock::now();
-        
-        std::ifstream random("/dev/random", std::ios::binary);
-        if (!random) {
-            throw std::runtime_error("Failed to open /dev/random");
-        }
+    if (!opts.plot) return;
 
-        random.read(buffer_.data(), CHUNK_SIZE);
-        
-        if (!random) {
-            throw std::runtime_error("Failed to read from /dev/random");
-        }
+    GraphPlotter scaling;
+    scaling.setTitle("RNG Throughput Scaling");
+    scaling.setXLabel("Reader threads");
+    scaling.setYLabel("Aggregate throughput (MB/s)");
+    for (const auto& bench : benchmarks) {
+        bench.add_scaling_graphs(scaling);
+    }
+    scaling.plot();
 
-        auto end = std::chrono::high_resolution_clock::now();
-        return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    GraphPlotter per_core;
+    per_core.setTitle("Per-core Read Latency");
+    per_core.setXLabel("CPU");
+    per_core.setYLabel("Average time (µs)");
+    for (const auto& bench : benchmarks) {
+        bench.add_per_core_graph(per_core);
+        per_core.setGraphStyle(&bench - benchmarks.data(), "linespoints");
     }
+    per_core.plot();
+}
 
-    void print_iteration_stats(size_t iteration, double duration_us) {
-        std::cout << "Iteration " << iteration + 1 << "/" << NUM_EXPERIMENTS
-                  << " completed in " << duration_us << " µs ("
-                  << CHUNK_SIZE/(duration_us/1e6)/1e6 << " MB/s)\n";
+static void run_interference(const BenchmarkOptions& opts) {
+    std::vector<InterferenceBenchmark> benchmarks;
+    for (const auto& name : opts.sources) {
+        benchmarks.emplace_back(name, opts.num_experiments, opts.chunk_size, opts.load, opts.load_levels,
+                                opts.source_settings);
+        benchmarks.back().use_clock(PrecisionClock::instance(opts.tsc));
+        benchmarks.back().run();
     }
 
-    void analyze_results() {
-        const double avg = std::accumulate(timings_.begin(), timings_.end(), 0.0) / timings_.size();
-        const auto [min, max] = std::minmax_element(timings_.begin(), timings_.end());
+    if (!opts.plot) return;
 
-        std::cout << "\n=== Benchmark Results ===\n"
-                  << "Samples: " << NUM_EXPERIMENTS << "\n"
-                  << "Chunk size: " << CHUNK_SIZE/(1024*1024) << " MB\n"
-                  << "Average time: " << avg << " µs\n"
-                  << "Minimum time: " << *min << " µs\n"
-                  << "Maximum time: " << *max << " µs\n"
-                  << "Average throughput: " << CHUNK_SIZE/(avg/1e6)/1e6 << " MB/s\n";
+    GraphPlotter plotter;
+    plotter.setTitle("RNG Latency under Background Load");
+    plotter.setXLabel("Stressor threads");
+    plotter.setYLabel("Latency (µs)");
+    for (const auto& bench : benchmarks) {
+        bench.add_percentile_graph(plotter, "p50", 50);
+        bench.add_percentile_graph(plotter, "p99", 99);
+    }
+    for (size_t i = 0; i < plotter.graphCount(); ++i) {
+        plotter.setGraphStyle(i, "linespoints");
     }
+    plotter.plot();
+}
 
-    void visualize_results() {
-        GraphPlotter plotter;
-        plotter.setTitle("Random Read Performance");
-        plotter.setXLabel("Iteration");
-        plotter.setYLabel("Time (µs)");
-        plotter.addGraph("8MB Read Latency", timings_);
-        plotter.plot();
+static void run_sweep(const BenchmarkOptions& opts) {
+    std::vector<ChunkSweepBenchmark> benchmarks;
+    for (const auto& name : opts.sources) {
+        benchmarks.emplace_back(name, opts.sweep_min, opts.sweep_max, opts.sweep_steps, opts.sweep_min_time,
+                                opts.source_settings);
+        benchmarks.back().run();
     }
-};
 
-int main() {
+    if (!opts.plot) return;
+
+    GraphPlotter throughput;
+    throughput.setTitle("Throughput vs Request Size");
+    throughput.setXLabel("Request size (bytes)");
+    throughput.setYLabel("Throughput (MB/s)");
+    throughput.setLogScale(true, true);
+    for (const auto& bench : benchmarks) {
+        bench.add_throughput_graph(throughput);
+    }
+    throughput.plot();
+
+    GraphPlotter ops;
+    ops.setTitle("Calls per Second vs Request Size");
+    ops.setXLabel("Request size (bytes)");
+    ops.setYLabel("ops/s");
+    ops.setLogScale(true, true);
+    for (const auto& bench : benchmarks) {
+        bench.add_ops_graph(ops);
+    }
+    ops.plot();
+}
+
+static void run_ab(const BenchmarkOptions& opts) {
+    const std::string& source = opts.sources.front();
+    ABArm baseline{source, source, nullptr, nullptr};
+    ABArm treatment;
+
+    if (!opts.ab_module.empty()) {
+        const std::string module = module_name_from_path(opts.ab_module);
+        if (is_kernel_module_loaded(module)) {
+            throw std::runtime_error("Module " + module + " is already loaded; unload it before an A/B run");
+        }
+        treatment.label = source + " + " + module;
+        treatment.source = source;
+        treatment.enter = [&]() { load_kernel_module(opts.ab_module, opts.ab_module_params); };
+        treatment.leave = [module]() { unload_kernel_module(module); };
+    } else {
+        treatment.label = opts.ab_source;
+        treatment.source = opts.ab_source;
+    }
+
+    ABComparison comparison(baseline, treatment, opts.ab_blocks, opts.num_experiments, opts.chunk_size,
+                            opts.source_settings);
+    comparison.use_clock(PrecisionClock::instance(opts.tsc));
+    comparison.run();
+
+    if (!opts.plot) return;
+
+    GraphPlotter plotter;
+    plotter.setTitle("A/B Block Latency");
+    plotter.setXLabel("Block");
+    plotter.setYLabel("Average time (µs)");
+    comparison.add_block_graphs(plotter);
+    plotter.setGraphStyle(0, "linespoints");
+    plotter.setGraphStyle(1, "linespoints");
+    plotter.plot();
+}
+
+// Exit status of a run that failed its regression check, and of one whose
+// check could not cover the baseline
+constexpr int EXIT_REGRESSION = 2;
+constexpr int EXIT_INCOMPLETE = 3;
+
+static int compare_exit_status(CompareStatus status) {
+    switch (status) {
+        case CompareStatus::Regression: return EXIT_REGRESSION;
+        case CompareStatus::Incomplete: return EXIT_INCOMPLETE;
+        default: return 0;
+    }
+}
+
+static ResultSet collect_results(const std::vector<RandomBenchmark>& benchmarks) {
+    ResultSet results;
+    results.env = EnvironmentInfo::current();
+    for (const auto& bench : benchmarks) {
+        RunRecord run;
+        run.source = bench.source_name();
+        run.chunk_size = bench.chunk_size();
+        run.histogram = bench.histogram();
+        run.samples.reserve(bench.timings().size());
+        for (double us : bench.timings()) {
+            run.samples.push_back(static_cast<uint64_t>(us * 1e3));
+        }
+        results.runs.push_back(std::move(run));
+    }
+    return results;
+}
+
+int main(int argc, char** argv) {
     try {
-        constexpr size_t NUM_EXPERIMENTS = 1000;
-        constexpr size_t CHUNK_SIZE = 8 * 1024 * 1024; // 8 MB
+        BenchmarkOptions opts = parse_options(argc, argv);
+        if (opts.help) {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (opts.list_sources) {
+            for (const auto& name : available_entropy_sources()) {
+                std::cout << name << "\n";
+            }
+            return 0;
+        }
+
+        if (!opts.compare_baseline.empty()) {
+            return compare_exit_status(compare_results(load_results(opts.compare_baseline),
+                                                       load_results(opts.compare_candidate), opts.max_regression));
+        }
+        if (!opts.ab_module.empty() || !opts.ab_source.empty()) {
+            run_ab(opts);
+            return 0;
+        }
+        if (!opts.load.empty()) {
+            run_interference(opts);
+            return 0;
+        }
+        if (opts.sweep) {
+            run_sweep(opts);
+            return 0;
+        }
+        if (opts.threads > 0) {
+            run_scaling(opts);
+            return 0;
+        }
 
-        RandomBenchmark benchmark(NUM_EXPERIMENTS, CHUNK_SIZE);
-        benchmark.run();
+        std::vector<RandomBenchmark> benchmarks;
+        for (const auto& name : opts.sources) {
+            benchmarks.emplace_back(opts.num_experiments, opts.chunk_size, make_entropy_source(name, opts.source_settings),
+                                    !opts.histogram_only, opts.stopping);
+            if (opts.perf) benchmarks.back().enable_perf_counters();
+            benchmarks.back().use_clock(PrecisionClock::instance(opts.tsc));
+            if (opts.quality) benchmarks.back().enable_quality_checks();
+            if (!opts.buffer_strategy.empty()) {
+                benchmarks.back().set_buffer_strategy(parse_buffer_strategy(opts.buffer_strategy), opts.buffer_align);
+            }
+            GraphPlotter live;
+            if (opts.live_plot) {
+                live.setDownsampling(parse_downsampling(opts.downsample), opts.plot_points);
+                live.setTitle(name + " (live)");
+                live.setXLabel("Iteration");
+                live.setYLabel("Time (µs)");
+                benchmarks.back().enable_live_plot(live, opts.plot_points);
+            }
+            benchmarks.back().run();
+        }
+
+        if (benchmarks.size() > 1) {
+            print_comparison(benchmarks);
+        }
+
+        int status = 0;
+        if (!opts.save_path.empty() || !opts.baseline_path.empty()) {
+            ResultSet results = collect_results(benchmarks);
+            if (!opts.save_path.empty()) {
+                save_results(opts.save_path, results);
+                std::cout << "Results written to " << opts.save_path << "\n";
+            }
+            if (!opts.baseline_path.empty()) {
+                status = compare_exit_status(compare_results(load_results(opts.baseline_path), results,
+                                                             opts.max_regression));
+            }
+        }
+
+        if (opts.plot) {
+            visualize_results(benchmarks, opts);
+        }
 
-        return 0;
+        return status;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
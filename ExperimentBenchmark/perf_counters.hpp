@@ -0,0 +1,173 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Per-thread hardware/software counters through perf_event_open(2). All
+// events that the machine supports are opened as one group on the calling
+// thread, so a single read() returns a consistent snapshot. Kernel-side
+// counting (where the crng and the hooks run) needs perf_event_paranoid <= 1
+// or CAP_PERFMON; otherwise the group falls back to user-space-only counts
+// and says so in mode().
+class PerfCounterGroup {
+public:
+    enum Counter { CYCLES, INSTRUCTIONS, CACHE_MISSES, CONTEXT_SWITCHES, PAGE_FAULTS, CPU_MIGRATIONS, COUNTER_COUNT };
+    using Values = std::array<uint64_t, COUNTER_COUNT>;
+
+    static const char* counter_name(size_t counter) {
+        static const char* names[] = {
+            "cycles", "instructions", "cache-misses", "context-switches", "page-faults", "cpu-migrations",
+        };
+        return names[counter];
+    }
+
+    PerfCounterGroup() {
+        if (!open_all(false)) {
+            close_all();
+            open_all(true);
+            user_only_ = true;
+        }
+    }
+
+    ~PerfCounterGroup() {
+        close_all();
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    bool available() const { return leader_ >= 0; }
+    bool supported(size_t counter) const { return fds_[counter] >= 0; }
+    std::string mode() const { return user_only_ ? "user-space only" : "user+kernel"; }
+
+    // Current counter values, scaled up if the PMU had to multiplex the
+    // group. Unsupported counters read as 0.
+    Values read_values() const {
+        Values values{};
+        if (leader_ < 0) return values;
+
+        // PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, value[nr]
+        uint64_t buf[3 + COUNTER_COUNT];
+        if (::read(leader_, buf, sizeof(buf)) < 0) return values;
+        const uint64_t nr = buf[0];
+        const double scale = buf[2] ? static_cast<double>(buf[1]) / buf[2] : 1.0;
+        for (uint64_t i = 0; i < nr && i < order_.size(); ++i) {
+            values[order_[i]] = static_cast<uint64_t>(buf[3 + i] * scale);
+        }
+        return values;
+    }
+
+private:
+    std::array<int, COUNTER_COUNT> fds_{};
+    std::vector<size_t> order_;  // group read order -> Counter
+    int leader_ = -1;
+    bool user_only_ = false;
+
+    static int perf_event_open(perf_event_attr* attr, int group_fd) {
+        return static_cast<int>(syscall(SYS_perf_event_open, attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    // Returns false only when nothing at all could be opened
+    bool open_all(bool user_only) {
+        static const std::pair<uint32_t, uint64_t> events[COUNTER_COUNT] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+        };
+
+        fds_.fill(-1);
+        order_.clear();
+        leader_ = -1;
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = user_only;
+            attr.exclude_hv = 1;
+            attr.disabled = leader_ < 0;  // the leader starts everything at once
+
+            int fd = perf_event_open(&attr, leader_);
+            if (fd < 0) continue;  // e.g. no PMU in a VM; keep the rest
+            fds_[i] = fd;
+            order_.push_back(i);
+            if (leader_ < 0) leader_ = fd;
+        }
+
+        if (leader_ < 0) return false;
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+
+    void close_all() {
+        for (auto& fd : fds_) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+        leader_ = -1;
+        order_.clear();
+    }
+};
+
+// Per-call counter deltas of one benchmark run
+class PerfCounterLog {
+public:
+    void set_supported(const PerfCounterGroup& group) {
+        for (size_t i = 0; i < supported_.size(); ++i) {
+            supported_[i] = supported_[i] || group.supported(i);
+        }
+    }
+    bool supported(size_t counter) const { return supported_[counter]; }
+
+    void record(const PerfCounterGroup::Values& before, const PerfCounterGroup::Values& after, bool keep) {
+        PerfCounterGroup::Values delta{};
+        for (size_t i = 0; i < delta.size(); ++i) {
+            delta[i] = after[i] - before[i];
+            totals_[i] += delta[i];
+            maxima_[i] = std::max(maxima_[i], delta[i]);
+        }
+        ++calls_;
+        if (keep) samples_.push_back(delta);
+    }
+
+    void merge(const PerfCounterLog& other) {
+        for (size_t i = 0; i < totals_.size(); ++i) {
+            totals_[i] += other.totals_[i];
+            maxima_[i] = std::max(maxima_[i], other.maxima_[i]);
+            supported_[i] = supported_[i] || other.supported_[i];
+        }
+        calls_ += other.calls_;
+    }
+
+    uint64_t calls() const { return calls_; }
+    const PerfCounterGroup::Values& totals() const { return totals_; }
+    const PerfCounterGroup::Values& maxima() const { return maxima_; }
+    const std::vector<PerfCounterGroup::Values>& samples() const { return samples_; }
+
+    double per_call(size_t counter) const {
+        return calls_ ? static_cast<double>(totals_[counter]) / calls_ : 0;
+    }
+
+private:
+    PerfCounterGroup::Values totals_{};
+    PerfCounterGroup::Values maxima_{};
+    std::vector<PerfCounterGroup::Values> samples_;
+    std::array<bool, PerfCounterGroup::COUNTER_COUNT> supported_{};
+    uint64_t calls_ = 0;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#define PRECISION_CLOCK_TSC 1
+#include <cpuid.h>
+#include <x86intrin.h>
+#else
+#define PRECISION_CLOCK_TSC 0
+#endif
+
+// Nanosecond interval timer for single calls. On CPUs with an invariant TSC
+// it reads the counter directly (lfence; rdtsc ... rdtscp; lfence, so the
+// measured code cannot be reordered around either read) and converts ticks
+// with a ratio calibrated against CLOCK_MONOTONIC_RAW. Elsewhere it falls
+// back to clock_gettime(CLOCK_MONOTONIC_RAW), as it always does on non-x86
+// hosts.
+//
+// The median cost of an empty start()/stop() pair is measured once and
+// subtracted from every interval, so a 16-byte read is not dominated by
+// the clock itself.
+class PrecisionClock {
+public:
+    enum class Kind { Tsc, MonotonicRaw };
+
+    // The default picks the TSC when it is invariant and rdtscp exists
+    explicit PrecisionClock(bool allow_tsc = true) {
+        kind_ = allow_tsc && tsc_usable() ? Kind::Tsc : Kind::MonotonicRaw;
+        if (kind_ == Kind::Tsc) calibrate();
+        measure_overhead();
+    }
+
+    // Calibrated once per process and kind
+    static const PrecisionClock& instance(bool allow_tsc = true) {
+        if (allow_tsc) {
+            static const PrecisionClock tsc(true);
+            return tsc;
+        }
+        static const PrecisionClock raw(false);
+        return raw;
+    }
+
+    Kind kind() const { return kind_; }
+    double overhead_ns() const { return overhead_ns_; }
+    double ns_per_tick() const { return ns_per_tick_; }
+
+    std::string describe() const {
+        std::ostringstream out;
+        if (kind_ == Kind::Tsc) {
+            out << "TSC @ " << 1.0 / ns_per_tick_ << " GHz";
+        } else {
+            out << "CLOCK_MONOTONIC_RAW";
+        }
+        out << ", " << overhead_ns_ << " ns overhead subtracted";
+        return out.str();
+    }
+
+    // Raw timestamps; only meaningful to elapsed_ns() of the same clock
+    uint64_t start() const {
+#if PRECISION_CLOCK_TSC
+        if (kind_ == Kind::Tsc) {
+            _mm_lfence();
+            const uint64_t t = __rdtsc();
+            _mm_lfence();
+            return t;
+        }
+#endif
+        return monotonic_raw_ns();
+    }
+
+    uint64_t stop() const {
+#if PRECISION_CLOCK_TSC
+        if (kind_ == Kind::Tsc) {
+            unsigned aux;
+            const uint64_t t = __rdtscp(&aux);
+            _mm_lfence();
+            return t;
+        }
+#endif
+        return monotonic_raw_ns();
+    }
+
+    // Interval in ns with the clock's own overhead removed, never negative
+    uint64_t elapsed_ns(uint64_t begin, uint64_t end) const {
+        const double ns = raw_ns(begin, end) - overhead_ns_;
+        return ns > 0 ? static_cast<uint64_t>(ns + 0.5) : 0;
+    }
+
+    static uint64_t monotonic_raw_ns() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    // CPUID 0x80000007 EDX[8] (invariant TSC) and 0x80000001 EDX[27] (rdtscp)
+    static bool tsc_usable() {
+#if !PRECISION_CLOCK_TSC
+        return false;
+#else
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) return false;
+        __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+        const bool rdtscp = edx & (1u << 27);
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        const bool invariant = edx & (1u << 8);
+        return rdtscp && invariant;
+#endif
+    }
+
+private:
+    Kind kind_;
+    double ns_per_tick_ = 1.0;
+    double overhead_ns_ = 0;
+
+    double raw_ns(uint64_t begin, uint64_t end) const {
+        return static_cast<double>(end - begin) * ns_per_tick_;
+    }
+
+    // Median of several 10 ms windows of TSC ticks against the raw monotonic
+    // clock; the median drops windows disturbed by preemption.
+    void calibrate() {
+#if PRECISION_CLOCK_TSC
+        constexpr int ROUNDS = 5;
+        constexpr uint64_t WINDOW_NS = 10 * 1000 * 1000;
+        std::vector<double> ratios;
+        for (int round = 0; round < ROUNDS; ++round) {
+            const uint64_t ns0 = monotonic_raw_ns();
+            const uint64_t tsc0 = __rdtsc();
+            uint64_t ns1;
+            do {
+                ns1 = monotonic_raw_ns();
+            } while (ns1 - ns0 < WINDOW_NS);
+            const uint64_t tsc1 = __rdtsc();
+            ratios.push_back(static_cast<double>(ns1 - ns0) / static_cast<double>(tsc1 - tsc0));
+        }
+        std::nth_element(ratios.begin(), ratios.begin() + ROUNDS / 2, ratios.end());
+        ns_per_tick_ = ratios[ROUNDS / 2];
+#endif
+    }
+
+    void measure_overhead() {
+        constexpr int SAMPLES = 10000;
+        std::vector<double> empty(SAMPLES);
+        for (auto& sample : empty) {
+            const uint64_t begin = start();
+            const uint64_t end = stop();
+            sample = raw_ns(begin, end);
+        }
+        std::nth_element(empty.begin(), empty.begin() + SAMPLES / 2, empty.end());
+        overhead_ns_ = empty[SAMPLES / 2];
+    }
+};
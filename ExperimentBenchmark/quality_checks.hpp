@@ -0,0 +1,436 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#define QUALITY_CHECKS_SIMD 1
+#include <immintrin.h>
+#else
+#define QUALITY_CHECKS_SIMD 0
+#endif
+
+// Streaming randomness-quality checks over every buffer the benchmark reads:
+// monobit (popcount), runs (bit transitions), byte chi-square, serial
+// correlation of consecutive bytes, and a count of all-zero 64-bit words,
+// which is what a hook that returns without writing leaves behind once the
+// benchmark poisons the buffer before each call.
+//
+// The bit-level work, the byte sums and the byte histogram run in one pass
+// with AVX2 or SSE4.2 kernels picked at runtime (target attributes, no
+// global -mavx2 needed) and a portable scalar fallback, the only kernel on
+// non-x86 hosts. A full byte histogram costs a dependent load-add-store per
+// byte and would halve the pass, so the chi-square test runs on a fixed 1/4
+// sample instead: of every whole 32-byte block, the 64-bit word at index
+// (block % 4), plus all the bytes of a trailing partial block. Every kernel
+// samples the same bytes.
+//
+// Each buffer is treated as an independent stream: transitions and byte
+// pairs are never counted across buffer boundaries.
+struct QualityCounters {
+    uint64_t bytes = 0;
+    uint64_t ones = 0;
+    uint64_t transitions = 0;
+    uint64_t zero_words = 0;
+    uint64_t sum_x = 0;
+    uint64_t sum_x2 = 0;
+    uint64_t sum_xy = 0;   // x[i] * x[i+1]
+    uint64_t pairs = 0;
+    uint64_t streams = 0;
+    uint64_t histogram_bytes = 0;   // bytes sampled into byte_counts
+    std::array<uint64_t, 256> byte_counts{};
+
+    void add(const QualityCounters& o) {
+        bytes += o.bytes;
+        ones += o.ones;
+        transitions += o.transitions;
+        zero_words += o.zero_words;
+        sum_x += o.sum_x;
+        sum_x2 += o.sum_x2;
+        sum_xy += o.sum_xy;
+        pairs += o.pairs;
+        streams += o.streams;
+        histogram_bytes += o.histogram_bytes;
+        for (size_t i = 0; i < 256; ++i) byte_counts[i] += o.byte_counts[i];
+    }
+};
+
+struct QualityVerdict {
+    double monobit_p = 1;
+    double runs_p = 1;
+    double chi_square = 0;
+    double chi_square_p = 1;
+    double serial_correlation = 0;
+    double serial_p = 1;
+    uint64_t zero_words = 0;
+
+    // A 64-bit zero word has probability 2^-64 in real random data, so a
+    // single one is conclusive; the statistical tests use a strict alpha
+    // because they run once per buffer.
+    bool failed(double alpha = 1e-6) const {
+        return zero_words > 0 || monobit_p < alpha || runs_p < alpha ||
+               chi_square_p < alpha || serial_p < alpha;
+    }
+
+    static QualityVerdict evaluate(const QualityCounters& c) {
+        QualityVerdict v;
+        v.zero_words = c.zero_words;
+        if (c.bytes == 0) return v;
+
+        const double n = 8.0 * c.bytes;
+        const double ones = static_cast<double>(c.ones);
+        v.monobit_p = std::erfc(std::fabs(2 * ones - n) / std::sqrt(n) / std::sqrt(2.0));
+
+        // NIST SP 800-22 runs test; runs = transitions + one per stream
+        const double pi = ones / n;
+        if (std::fabs(pi - 0.5) >= 2 / std::sqrt(n)) {
+            v.runs_p = 0;
+        } else {
+            const double runs = static_cast<double>(c.transitions + c.streams);
+            v.runs_p = std::erfc(std::fabs(runs - 2 * n * pi * (1 - pi)) /
+                                 (2 * std::sqrt(2 * n) * pi * (1 - pi)));
+        }
+
+        // 255 degrees of freedom, Wilson-Hilferty normal approximation
+        const double expected = c.histogram_bytes / 256.0;
+        double chi = 0;
+        for (auto count : c.byte_counts) {
+            const double d = count - expected;
+            chi += d * d / expected;
+        }
+        v.chi_square = chi;
+        const double k = 255;
+        const double z = (std::cbrt(chi / k) - (1 - 2 / (9 * k))) / std::sqrt(2 / (9 * k));
+        v.chi_square_p = c.histogram_bytes >= 5 * 256 ? 0.5 * std::erfc(z / std::sqrt(2.0)) : 1.0;
+
+        if (c.pairs > 1) {
+            const double N = static_cast<double>(c.bytes);
+            const double sx = static_cast<double>(c.sum_x);
+            const double denom = N * c.sum_x2 - sx * sx;
+            v.serial_correlation = denom > 0 ? (N * (c.sum_xy * N / c.pairs) - sx * sx) / denom : 1.0;
+            v.serial_p = std::erfc(std::fabs(v.serial_correlation) * std::sqrt(static_cast<double>(c.pairs)) /
+                                   std::sqrt(2.0));
+        }
+        return v;
+    }
+};
+
+namespace quality_detail {
+
+// Transitions of word w given the last bit of the preceding word: bit j of
+// w ^ ((w << 1) | carry) is b[j] ^ b[j-1].
+inline uint64_t word_transitions(uint64_t w, uint64_t prev_top_bit) {
+    return static_cast<uint64_t>(__builtin_popcountll(w ^ ((w << 1) | prev_top_bit)));
+}
+
+// Everything after the vector kernel: whole words, then single bytes. The
+// byte pass handles histogram, sums and pairs for the whole buffer.
+inline void scalar_tail(const unsigned char* p, size_t begin, size_t len, uint64_t prev_top_bit,
+                        QualityCounters& c) {
+    size_t i = begin;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        c.ones += __builtin_popcountll(w);
+        c.transitions += word_transitions(w, prev_top_bit);
+        c.zero_words += w == 0;
+        prev_top_bit = w >> 63;
+    }
+    for (; i < len; ++i) {
+        const unsigned b = p[i];
+        c.ones += __builtin_popcount(b);
+        c.transitions += __builtin_popcount((b ^ ((b << 1) | prev_top_bit)) & 0xFF);
+        prev_top_bit = b >> 7;
+    }
+}
+
+inline void scalar_sums(const unsigned char* p, size_t begin, size_t len, QualityCounters& c) {
+    if (begin >= len) return;
+    for (size_t i = begin; i + 1 < len; ++i) {
+        c.sum_x += p[i];
+        c.sum_x2 += p[i] * p[i];
+        c.sum_xy += p[i] * p[i + 1];
+    }
+    c.sum_x += p[len - 1];
+    c.sum_x2 += p[len - 1] * p[len - 1];
+}
+
+constexpr size_t HISTOGRAM_BLOCK = 32;
+
+inline void count_word(uint64_t w, QualityCounters& c) {
+    for (int k = 0; k < 8; ++k, w >>= 8) ++c.byte_counts[w & 0xFF];
+}
+
+// Offset of the sampled word in the whole block starting at `block_start`
+inline size_t sampled_offset(size_t block_start) {
+    return block_start + 8 * ((block_start / HISTOGRAM_BLOCK) & 3);
+}
+
+// Byte histogram under the sampling rule above. A vector kernel that
+// already counted the sampled words before `begin` hands over the rest of
+// the whole blocks here, even in the middle of a block; the partial block
+// at the end is never counted by a kernel and is always done here.
+inline void sampled_histogram(const unsigned char* p, size_t begin, size_t len, QualityCounters& c) {
+    const size_t whole = len - len % HISTOGRAM_BLOCK;
+    for (size_t i = begin; i < whole; i = i - i % HISTOGRAM_BLOCK + HISTOGRAM_BLOCK) {
+        const size_t sample = sampled_offset(i - i % HISTOGRAM_BLOCK);
+        if (sample < i) continue;
+        uint64_t w;
+        std::memcpy(&w, p + sample, 8);
+        count_word(w, c);
+        c.histogram_bytes += 8;
+    }
+    for (size_t i = whole; i < len; ++i) {
+        ++c.byte_counts[p[i]];
+        ++c.histogram_bytes;
+    }
+}
+
+inline void process_scalar(const unsigned char* p, size_t len, QualityCounters& c) {
+    uint64_t first = len ? (p[0] & 1) : 0;  // no transition before the first bit
+    scalar_tail(p, 0, len, first, c);
+    scalar_sums(p, 0, len, c);
+    sampled_histogram(p, 0, len, c);
+}
+
+#if QUALITY_CHECKS_SIMD
+__attribute__((target("avx2,popcnt")))
+inline __m256i popcount_bytes_avx2(__m256i v) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+    const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2,popcnt")))
+inline uint64_t hsum_epi64_avx2(__m256i v) {
+    return static_cast<uint64_t>(_mm256_extract_epi64(v, 0)) + static_cast<uint64_t>(_mm256_extract_epi64(v, 1)) +
+           static_cast<uint64_t>(_mm256_extract_epi64(v, 2)) + static_cast<uint64_t>(_mm256_extract_epi64(v, 3));
+}
+
+__attribute__((target("avx2,popcnt")))
+inline void process_avx2(const unsigned char* p, size_t len, QualityCounters& c) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i ones = zero, trans = zero, sum_x = zero;
+    __m256i sum_x2_64 = zero, sum_xy_64 = zero;
+    __m256i sum_x2_32 = zero, sum_xy_32 = zero;
+    uint64_t zero_words = 0;
+    uint64_t sampled = 0;
+
+    // The vector loop reads p[i + 1 .. i + 32] for the byte pairs, so it
+    // stops one vector early and leaves the rest to the scalar tail. Each
+    // step is one whole histogram block.
+    size_t i = 0;
+    __m256i prev = len >= 8 ? _mm256_set1_epi64x(static_cast<int64_t>((p[0] & 1ULL) << 63)) : zero;
+    size_t flush = 0;
+    for (; i + 33 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 1));
+
+        ones = _mm256_add_epi64(ones, popcount_bytes_avx2(v));
+
+        // Previous 64-bit word of every lane: [prev.w3, v.w0, v.w1, v.w2]
+        const __m256i cross = _mm256_permute2x128_si256(prev, v, 0x21);
+        const __m256i before = _mm256_alignr_epi8(v, cross, 8);
+        const __m256i carry = _mm256_srli_epi64(before, 63);
+        const __m256i x = _mm256_xor_si256(v, _mm256_or_si256(_mm256_slli_epi64(v, 1), carry));
+        trans = _mm256_add_epi64(trans, popcount_bytes_avx2(x));
+        prev = v;
+
+        zero_words += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi64(v, zero))) / 8;
+
+        // The sampled word is in L1 after the vector load
+        uint64_t w;
+        std::memcpy(&w, p + sampled_offset(i), 8);
+        count_word(w, c);
+        sampled += 8;
+
+        sum_x = _mm256_add_epi64(sum_x, _mm256_sad_epu8(v, zero));
+        const __m256i v_lo = _mm256_unpacklo_epi8(v, zero), v_hi = _mm256_unpackhi_epi8(v, zero);
+        const __m256i n_lo = _mm256_unpacklo_epi8(next, zero), n_hi = _mm256_unpackhi_epi8(next, zero);
+        sum_x2_32 = _mm256_add_epi32(sum_x2_32, _mm256_add_epi32(_mm256_madd_epi16(v_lo, v_lo), _mm256_madd_epi16(v_hi, v_hi)));
+        sum_xy_32 = _mm256_add_epi32(sum_xy_32, _mm256_add_epi32(_mm256_madd_epi16(v_lo, n_lo), _mm256_madd_epi16(v_hi, n_hi)));
+
+        // 32-bit lanes gain at most 260100 per step; widen well before 2^31
+        if (++flush == 4096) {
+            sum_x2_64 = _mm256_add_epi64(sum_x2_64, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sum_x2_32)));
+            sum_x2_64 = _mm256_add_epi64(sum_x2_64, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sum_x2_32, 1)));
+            sum_xy_64 = _mm256_add_epi64(sum_xy_64, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sum_xy_32)));
+            sum_xy_64 = _mm256_add_epi64(sum_xy_64, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sum_xy_32, 1)));
+            sum_x2_32 = sum_xy_32 = zero;
+            flush = 0;
+        }
+    }
+    sum_x2_64 = _mm256_add_epi64(sum_x2_64, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sum_x2_32)));
+    sum_x2_64 = _mm256_add_epi64(sum_x2_64, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sum_x2_32, 1)));
+    sum_xy_64 = _mm256_add_epi64(sum_xy_64, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sum_xy_32)));
+    sum_xy_64 = _mm256_add_epi64(sum_xy_64, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sum_xy_32, 1)));
+
+    c.ones += hsum_epi64_avx2(ones);
+    c.transitions += hsum_epi64_avx2(trans);
+    c.zero_words += zero_words;
+    c.sum_x += hsum_epi64_avx2(sum_x);
+    c.sum_x2 += hsum_epi64_avx2(sum_x2_64);
+    c.sum_xy += hsum_epi64_avx2(sum_xy_64);
+    c.histogram_bytes += sampled;
+
+    const uint64_t prev_top = i ? static_cast<uint64_t>(_mm256_extract_epi64(prev, 3)) >> 63 : (len ? (p[0] & 1) : 0);
+    scalar_tail(p, i, len, prev_top, c);
+    scalar_sums(p, i, len, c);
+    sampled_histogram(p, i, len, c);
+}
+
+__attribute__((target("sse4.2,popcnt")))
+inline void process_sse42(const unsigned char* p, size_t len, QualityCounters& c) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum_x = zero, sum_x2_32 = zero, sum_xy_32 = zero;
+    uint64_t sum_x2 = 0, sum_xy = 0;
+    uint64_t prev_top = len ? (p[0] & 1) : 0;
+    size_t flush = 0;
+    const size_t whole = len - len % HISTOGRAM_BLOCK;
+    uint64_t sampled = 0;
+
+    size_t i = 0;
+    for (; i + 17 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1));
+
+        const uint64_t w0 = static_cast<uint64_t>(_mm_extract_epi64(v, 0));
+        const uint64_t w1 = static_cast<uint64_t>(_mm_extract_epi64(v, 1));
+        c.ones += _mm_popcnt_u64(w0) + _mm_popcnt_u64(w1);
+        c.transitions += _mm_popcnt_u64(w0 ^ ((w0 << 1) | prev_top)) + _mm_popcnt_u64(w1 ^ ((w1 << 1) | (w0 >> 63)));
+        c.zero_words += (w0 == 0) + (w1 == 0);
+        prev_top = w1 >> 63;
+
+        // A block spans two vectors; count its sampled word with the one holding it
+        const size_t sample = sampled_offset(i - i % HISTOGRAM_BLOCK);
+        if (i < whole && sample - i < 16) {
+            count_word(sample == i ? w0 : w1, c);
+            sampled += 8;
+        }
+
+        sum_x = _mm_add_epi64(sum_x, _mm_sad_epu8(v, zero));
+        const __m128i v_lo = _mm_unpacklo_epi8(v, zero), v_hi = _mm_unpackhi_epi8(v, zero);
+        const __m128i n_lo = _mm_unpacklo_epi8(next, zero), n_hi = _mm_unpackhi_epi8(next, zero);
+        sum_x2_32 = _mm_add_epi32(sum_x2_32, _mm_add_epi32(_mm_madd_epi16(v_lo, v_lo), _mm_madd_epi16(v_hi, v_hi)));
+        sum_xy_32 = _mm_add_epi32(sum_xy_32, _mm_add_epi32(_mm_madd_epi16(v_lo, n_lo), _mm_madd_epi16(v_hi, n_hi)));
+
+        if (++flush == 4096) {
+            alignas(16) uint32_t a[4], b[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(a), sum_x2_32);
+            _mm_store_si128(reinterpret_cast<__m128i*>(b), sum_xy_32);
+            for (int k = 0; k < 4; ++k) { sum_x2 += a[k]; sum_xy += b[k]; }
+            sum_x2_32 = sum_xy_32 = zero;
+            flush = 0;
+        }
+    }
+    alignas(16) uint32_t a[4], b[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(a), sum_x2_32);
+    _mm_store_si128(reinterpret_cast<__m128i*>(b), sum_xy_32);
+    for (int k = 0; k < 4; ++k) { sum_x2 += a[k]; sum_xy += b[k]; }
+
+    c.sum_x += static_cast<uint64_t>(_mm_extract_epi64(sum_x, 0)) + static_cast<uint64_t>(_mm_extract_epi64(sum_x, 1));
+    c.sum_x2 += sum_x2;
+    c.sum_xy += sum_xy;
+    c.histogram_bytes += sampled;
+
+    scalar_tail(p, i, len, prev_top, c);
+    scalar_sums(p, i, len, c);
+    sampled_histogram(p, i, len, c);
+}
+#endif
+
+} // namespace quality_detail
+
+class StreamingQualityCheck {
+public:
+    enum class Kernel { Scalar, SSE42, AVX2 };
+
+    explicit StreamingQualityCheck(bool allow_simd = true) {
+        kernel_ = Kernel::Scalar;
+#if QUALITY_CHECKS_SIMD
+        if (allow_simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            kernel_ = Kernel::AVX2;
+        } else if (allow_simd && __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+            kernel_ = Kernel::SSE42;
+        }
+#else
+        (void)allow_simd;
+#endif
+    }
+
+    const char* kernel_name() const {
+        switch (kernel_) {
+            case Kernel::AVX2: return "AVX2";
+            case Kernel::SSE42: return "SSE4.2";
+            default: return "scalar";
+        }
+    }
+
+    // Checks one freshly filled buffer; returns its own verdict and folds
+    // its counters into the running totals.
+    QualityVerdict process(const char* data, size_t len) {
+        auto start = std::chrono::steady_clock::now();
+
+        const auto* p = reinterpret_cast<const unsigned char*>(data);
+        QualityCounters chunk;
+        chunk.bytes = len;
+        chunk.streams = len ? 1 : 0;
+        chunk.pairs = len ? len - 1 : 0;
+        switch (kernel_) {
+#if QUALITY_CHECKS_SIMD
+            case Kernel::AVX2: quality_detail::process_avx2(p, len, chunk); break;
+            case Kernel::SSE42: quality_detail::process_sse42(p, len, chunk); break;
+#endif
+            default: quality_detail::process_scalar(p, len, chunk); break;
+        }
+
+        // Per-buffer tests only have power on reasonably large buffers;
+        // small reads are judged by the cumulative totals instead.
+        QualityVerdict verdict;
+        verdict.zero_words = chunk.zero_words;
+        if (len >= MIN_TESTED_BUFFER) {
+            verdict = QualityVerdict::evaluate(chunk);
+        }
+        if (verdict.failed()) ++failed_buffers_;
+        ++buffers_;
+        totals_.add(chunk);
+
+        check_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return verdict;
+    }
+
+    const QualityCounters& totals() const { return totals_; }
+    uint64_t buffers() const { return buffers_; }
+    uint64_t failed_buffers() const { return failed_buffers_; }
+    double check_throughput() const { return check_seconds_ > 0 ? totals_.bytes / check_seconds_ / 1e6 : 0; }
+
+    void print_summary() const {
+        const auto v = QualityVerdict::evaluate(totals_);
+        std::cout << "Quality (" << kernel_name() << ", " << check_throughput() << " MB/s checked): "
+                  << buffers_ << " buffers, " << failed_buffers_ << " failed\n"
+                  << "  monobit p=" << v.monobit_p << ", runs p=" << v.runs_p
+                  << ", chi-square=" << v.chi_square << " (p=" << v.chi_square_p << ", "
+                  << totals_.histogram_bytes << " bytes sampled)"
+                  << ", serial corr=" << v.serial_correlation << " (p=" << v.serial_p << ")"
+                  << ", zero words=" << v.zero_words << "\n";
+        if (failed_buffers_ || v.failed()) {
+            std::cout << "  WARNING: output does not look random - a hook may be returning unfilled buffers\n";
+        }
+    }
+
+private:
+    static constexpr size_t MIN_TESTED_BUFFER = 4096;
+
+    Kernel kernel_;
+    QualityCounters totals_;
+    uint64_t buffers_ = 0;
+    uint64_t failed_buffers_ = 0;
+    double check_seconds_ = 0;
+};
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+#include "entropy_source.hpp"
+#include "size_units.hpp"
+#include "latency_histogram.hpp"
+#include "steady_state.hpp"
+#include "perf_counters.hpp"
+#include "quality_checks.hpp"
+#include "benchmark_buffer.hpp"
+#include "precision_clock.hpp"
+#include "graph_plotter.hpp"
+
+// Adaptive mode: NUM_EXPERIMENTS becomes an upper bound, warmup is cut off by
+// MSER-5 and the run stops once the 95% CI of the steady-state mean is
+// narrower than target_ci (relative half-width) or the time budget is spent.
+struct StoppingRule {
+    bool adaptive = false;
+    double target_ci = 0.01;
+    double time_budget_s = 0;  // 0 = no budget
+    size_t min_iterations = 50;
+};
+
+class RandomBenchmark {
+public:
+    // With keep_samples = false only the histogram is kept, so memory stays
+    // constant no matter how many iterations are run.
+    RandomBenchmark(size_t num_experiments, size_t chunk_size, std::unique_ptr<EntropySource> source,
+                    bool keep_samples = true, const StoppingRule& stopping = {})
+        : NUM_EXPERIMENTS(num_experiments),
+          CHUNK_SIZE(chunk_size),
+          KEEP_SAMPLES(keep_samples),
+          STOPPING(stopping),
+          source_(std::move(source)) {}
+
+    // Reads the perf counter group around every call; the group is opened
+    // in run() so it is attached to the thread that does the reads.
+    void enable_perf_counters() { perf_enabled_ = true; }
+
+    // Zeroes the buffer before each call and checks what the source left in
+    // it afterwards, both outside the timed region. A source that returns
+    // without writing (as the ftrace demo hook does) shows up as zero words
+    // and failed buffers instead of silently reusing the last call's data.
+    void enable_quality_checks() { quality_ = std::make_unique<StreamingQualityCheck>(); }
+
+    void use_clock(const PrecisionClock& clock) { clock_ = &clock; }
+
+    // Picks how the destination buffer is allocated (see benchmark_buffer.hpp)
+    // and counts the page faults taken inside the timed calls.
+    void set_buffer_strategy(BufferStrategy strategy, size_t alignment = 4096) {
+        buffer_strategy_ = strategy;
+        buffer_alignment_ = alignment;
+        count_faults_ = true;
+    }
+
+    // Appends every sample to a live graph of `plotter` holding the last
+    // `capacity` of them; the window is redrawn LIVE_REFRESH_HZ times per
+    // second at most, between iterations, never inside a timed call.
+    void enable_live_plot(GraphPlotter& plotter, size_t capacity) {
+        live_plot_ = &plotter;
+        live_capacity_ = capacity;
+    }
+
+    void run() {
+        buffer_ = std::make_unique<BenchmarkBuffer>(buffer_strategy_, CHUNK_SIZE, buffer_alignment_);
+        if (count_faults_) {
+            fault_cost_us_ = first_touch_fault_us();
+        }
+
+        if (perf_enabled_) {
+            perf_group_ = std::make_unique<PerfCounterGroup>();
+            if (!perf_group_->available()) {
+                std::cerr << "Warning: perf_event_open failed, counters disabled\n";
+                perf_group_.reset();
+            } else {
+                perf_log_.set_supported(*perf_group_);
+            }
+        }
+
+        std::cout << "Starting " << source_->name() << " benchmark with " << NUM_EXPERIMENTS
+                  << " iterations of " << format_size(CHUNK_SIZE) << " reads\n";
+
+        // Adaptive stopping needs the series even in histogram-only mode
+        const bool store = KEEP_SAMPLES || STOPPING.adaptive;
+        if (store) {
+            timings_.reserve(NUM_EXPERIMENTS);
+        }
+
+        const auto started = std::chrono::steady_clock::now();
+        size_t next_check = STOPPING.min_iterations;
+        stop_reason_ = "iteration limit";
+
+        size_t live_graph = 0;
+        if (live_plot_) {
+            live_graph = live_plot_->addLiveGraph(source_->name() + " Read Latency", live_capacity_);
+            live_plot_->startLive(LIVE_REFRESH_HZ);
+        }
+
+        for (size_t i = 0; i < NUM_EXPERIMENTS; ++i) {
+            auto duration = run_single_iteration(i);
+            if (store) {
+                timings_.push_back(duration);
+            }
+            if (KEEP_SAMPLES) {
+                print_iteration_stats(i, duration);
+            }
+            if (live_plot_) {
+                live_plot_->append(live_graph, i + 1, duration);
+                live_plot_->refresh();
+            }
+
+            // Re-evaluating costs O(n), so checks get sparser as n grows
+            if (STOPPING.adaptive && i + 1 >= next_check) {
+                if (converged()) {
+                    stop_reason_ = "converged";
+                    break;
+                }
+                next_check = i + 1 + std::max<size_t>(10, (i + 1) / 10);
+            }
+            if (STOPPING.time_budget_s > 0 &&
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() >= STOPPING.time_budget_s) {
+                stop_reason_ = "time budget";
+                break;
+            }
+        }
+
+        if (live_plot_) {
+            live_plot_->finishLive();
+            live_plot_ = nullptr;  // the plotter need not outlive run()
+        }
+
+        if (STOPPING.adaptive) {
+            finalize_steady_state();
+        }
+
+        analyze_results();
+    }
+
+    std::string source_name() const { return source_->name(); }
+    size_t chunk_size() const { return CHUNK_SIZE; }
+    const std::vector<double>& timings() const { return timings_; }
+    const LatencyHistogram& histogram() const { return histogram_; }
+
+    // µs, computed from the histogram so it is available without samples
+    double average_time() const { return histogram_.mean() / 1e3; }
+
+    const PerfCounterLog* perf_log() const { return perf_group_ ? &perf_log_ : nullptr; }
+    size_t warmup_count() const { return warmup_; }
+    const std::vector<size_t>& outliers() const { return outliers_; }
+    const StreamingQualityCheck* quality() const { return quality_.get(); }
+
+private:
+    const size_t NUM_EXPERIMENTS;
+    const size_t CHUNK_SIZE;
+    const bool KEEP_SAMPLES;
+    const StoppingRule STOPPING;
+    static constexpr double LIVE_REFRESH_HZ = 5;
+    BufferStrategy buffer_strategy_ = BufferStrategy::Vector;
+    size_t buffer_alignment_ = 4096;
+    std::unique_ptr<BenchmarkBuffer> buffer_;
+    const PrecisionClock* clock_ = &PrecisionClock::instance();
+    bool count_faults_ = false;
+    PageFaults timed_faults_;
+    double fault_cost_us_ = 0;
+    std::vector<double> timings_;
+    LatencyHistogram histogram_;  // ns, every call (steady state only in adaptive mode)
+    std::unique_ptr<EntropySource> source_;
+    size_t warmup_ = 0;
+    std::vector<size_t> outliers_;
+    ConfidenceInterval mean_ci_;
+    std::string stop_reason_;
+    bool perf_enabled_ = false;
+    std::unique_ptr<PerfCounterGroup> perf_group_;
+    PerfCounterLog perf_log_;
+    std::unique_ptr<StreamingQualityCheck> quality_;
+    GraphPlotter* live_plot_ = nullptr;
+    size_t live_capacity_ = 0;
+
+    bool converged() {
+        const size_t warmup = mser5_truncation(timings_);
+        if (timings_.size() - warmup < STOPPING.min_iterations) return false;
+        mean_ci_ = batch_means_ci(timings_, warmup);
+        return mean_ci_.estimate > 0 &&
+               (mean_ci_.upper - mean_ci_.estimate) / mean_ci_.estimate <= STOPPING.target_ci;
+    }
+
+    // Drops the warmup prefix from the histogram and flags outliers in the rest
+    void finalize_steady_state() {
+        warmup_ = mser5_truncation(timings_);
+        mean_ci_ = batch_means_ci(timings_, warmup_);
+        outliers_ = flag_outliers(timings_, warmup_);
+
+        histogram_.reset();
+        for (size_t i = warmup_; i < timings_.size(); ++i) {
+            histogram_.record(static_cast<uint64_t>(std::llround(timings_[i] * 1e3)));
+        }
+    }
+
+    double run_single_iteration(size_t iteration) {
+        char* buffer = buffer_->next();
+        if (quality_) std::memset(buffer, 0, CHUNK_SIZE);
+
+        PageFaults faults_before;
+        if (count_faults_) faults_before = PageFaults::current();
+        PerfCounterGroup::Values before{};
+        if (perf_group_) before = perf_group_->read_values();
+
+        const uint64_t start = clock_->start();
+
+        source_->fill(buffer, CHUNK_SIZE);
+
+        const uint64_t end = clock_->stop();
+        if (perf_group_) perf_log_.record(before, perf_group_->read_values(), KEEP_SAMPLES);
+        if (count_faults_) {
+            const auto delta = PageFaults::current() - faults_before;
+            timed_faults_.minor += delta.minor;
+            timed_faults_.major += delta.major;
+        }
+        if (quality_) quality_->process(buffer, CHUNK_SIZE);
+
+        const uint64_t ns = clock_->elapsed_ns(start, end);
+        histogram_.record(ns);
+        return ns / 1e3;
+    }
+
+    void print_iteration_stats(size_t iteration, double duration_us) {
+        std::cout << "Iteration " << iteration + 1 << "/" << NUM_EXPERIMENTS
+                  << " completed in " << duration_us << " µs ("
+                  << CHUNK_SIZE/(duration_us/1e6)/1e6 << " MB/s)\n";
+    }
+
+    void analyze_results() {
+        const double avg = average_time();
+
+        std::cout << "\n=== Benchmark Results (" << source_->name() << ") ===\n"
+                  << "Samples: " << histogram_.count() << "\n"
+                  << "Chunk size: " << format_size(CHUNK_SIZE) << "\n"
+                  << "Clock: " << clock_->describe() << "\n"
+                  << "Average time: " << avg << " µs\n"
+                  << "Minimum time: " << histogram_.min() / 1e3 << " µs\n";
+        for (const auto& [label, percentile] : report_percentiles()) {
+            std::cout << label << " time: " << histogram_.value_at_percentile(percentile) / 1e3 << " µs\n";
+        }
+        std::cout << "Maximum time: " << histogram_.max() / 1e3 << " µs\n"
+                  << "Average throughput: " << CHUNK_SIZE/(avg/1e6)/1e6 << " MB/s\n";
+        if (STOPPING.adaptive) {
+            std::cout << "Stopped by: " << stop_reason_ << " after " << timings_.size() << " iterations\n"
+                      << "Warmup discarded: " << warmup_ << " iterations\n"
+                      << "Mean 95% CI: [" << mean_ci_.lower << ", " << mean_ci_.upper << "] µs (±"
+                      << 100.0 * (mean_ci_.upper - mean_ci_.estimate) / mean_ci_.estimate << " %)\n"
+                      << "Outliers flagged: " << outliers_.size();
+            if (!outliers_.empty()) {
+                const auto worst = *std::max_element(outliers_.begin(), outliers_.end(),
+                    [&](size_t a, size_t b) { return timings_[a] < timings_[b]; });
+                std::cout << " (largest " << timings_[worst] << " µs at iteration " << worst + 1 << ")";
+            }
+            std::cout << "\n";
+        }
+        if (perf_group_) {
+            print_perf_counters();
+        }
+        if (quality_) {
+            quality_->print_summary();
+        }
+        if (count_faults_) {
+            print_page_faults();
+        }
+        for (const auto& [label, h] : source_->extra_latencies()) {
+            if (h->count() == 0) continue;
+            std::cout << label << " time: " << h->count() << " calls, avg " << h->mean() / 1e3
+                      << " µs, p50 " << h->value_at_percentile(50) / 1e3
+                      << " µs, p99 " << h->value_at_percentile(99) / 1e3
+                      << " µs, max " << h->max() / 1e3 << " µs\n";
+        }
+    }
+
+    // Fault time inside the calls is estimated from the calibrated cost of a
+    // first-touch fault, since the calls cannot be split any finer.
+    void print_page_faults() const {
+        const auto& setup = buffer_->setup_faults();
+        const double calls = static_cast<double>(histogram_.count());
+        std::cout << "Buffer: " << buffer_->describe() << ", setup " << setup.total() << " faults in "
+                  << buffer_->setup_us() << " µs\n"
+                  << "Page faults in timed calls: " << timed_faults_.minor << " minor, " << timed_faults_.major
+                  << " major (" << (calls > 0 ? timed_faults_.total() / calls : 0) << " per call)\n";
+        if (fault_cost_us_ > 0 && calls > 0) {
+            const double fault_us = timed_faults_.minor * fault_cost_us_ / calls;
+            std::cout << "Estimated fault time: " << fault_us << " µs per call ("
+                      << 100.0 * fault_us / average_time() << " % of read time, "
+                      << fault_cost_us_ << " µs per first-touch fault)\n";
+        }
+    }
+
+    void print_perf_counters() const {
+        std::cout << "Perf counters (" << perf_group_->mode() << ", per call / max in one call):\n";
+        for (size_t i = 0; i < PerfCounterGroup::COUNTER_COUNT; ++i) {
+            if (!perf_log_.supported(i)) continue;
+            std::cout << "  " << PerfCounterGroup::counter_name(i) << ": "
+                      << perf_log_.per_call(i) << " / " << perf_log_.maxima()[i] << "\n";
+        }
+        const double cycles = perf_log_.per_call(PerfCounterGroup::CYCLES);
+        if (cycles > 0) {
+            std::cout << "  IPC: " << perf_log_.per_call(PerfCounterGroup::INSTRUCTIONS) / cycles << "\n"
+                      << "  cycles/byte: " << cycles / CHUNK_SIZE << "\n";
+        }
+    }
+};
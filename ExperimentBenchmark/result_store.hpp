@@ -0,0 +1,306 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <stdexcept>
+#include <algorithm>
+#include "latency_histogram.hpp"
+#include "size_units.hpp"
+
+// Versioned, line-oriented results file. Each run keeps its sparse latency
+// histogram (exact enough to recompute any percentile) and, when the run
+// kept them, every per-call sample in ns:
+//
+//   rngbench-results 1
+//   kernel 6.1.0-18-amd64
+//   cpu Intel(R) Core(TM) i7-8650U CPU @ 1.90GHz
+//   modules kprobe_override,...
+//   created 2024-05-01T12:00:00Z
+//   run getrandom 8388608
+//   cell <config> <threads> <repetition> <wall us> <MB/s>
+//   stats <count> <min> <max> <sum>
+//   histogram <bucket>:<count> ...
+//   samples <ns> <ns> ...
+//   end
+//
+// The cell line is written for matrix runs only; version 2 added it with
+// the first three fields, version 3 the wall time and aggregate MB/s.
+constexpr int RESULTS_FORMAT_VERSION = 3;
+constexpr int RESULTS_FORMAT_OLDEST = 1;  // oldest version load_results() still reads
+
+struct EnvironmentInfo {
+    std::string kernel;
+    std::string cpu;
+    std::string modules;  // comma-separated names from /proc/modules
+    std::string created;
+
+    // Same parsing as get_kernel_version() in the CLI
+    static std::string read_kernel_version() {
+        std::ifstream f("/proc/version");
+        std::string linux_word, version_word, version;
+        if (f >> linux_word >> version_word >> version) return version;
+        return "unknown";
+    }
+
+    static std::string read_cpu_model() {
+        std::ifstream f("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(f, line)) {
+            if (line.rfind("model name", 0) == 0) {
+                auto colon = line.find(':');
+                if (colon != std::string::npos) {
+                    return line.substr(line.find_first_not_of(' ', colon + 1));
+                }
+            }
+        }
+        return "unknown";
+    }
+
+    static std::string read_loaded_modules() {
+        std::ifstream f("/proc/modules");
+        std::vector<std::string> names;
+        std::string line;
+        while (std::getline(f, line)) {
+            names.push_back(line.substr(0, line.find(' ')));
+        }
+        std::sort(names.begin(), names.end());
+        std::string joined;
+        for (const auto& n : names) {
+            if (!joined.empty()) joined += ',';
+            joined += n;
+        }
+        return joined;
+    }
+
+    static EnvironmentInfo current() {
+        EnvironmentInfo env;
+        env.kernel = read_kernel_version();
+        env.cpu = read_cpu_model();
+        env.modules = read_loaded_modules();
+
+        char stamp[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        env.created = stamp;
+        return env;
+    }
+};
+
+struct RunRecord {
+    std::string source;
+    size_t chunk_size = 0;
+    std::string config;               // hook configuration of a matrix cell, empty otherwise
+    size_t threads = 1;
+    size_t repetition = 0;
+    double wall_us = 0;               // matrix cells: wall time of all threads together
+    double aggregate_throughput = 0;  // matrix cells: MB/s over all threads
+    LatencyHistogram histogram;       // ns
+    std::vector<uint64_t> samples;    // ns, empty for histogram-only runs
+
+    // MB/s. A matrix cell with several threads reads in parallel, so the
+    // per-call mean would understate it; cells carry the measured aggregate.
+    double throughput() const {
+        if (aggregate_throughput > 0) return aggregate_throughput;
+        const double mean_ns = histogram.mean();
+        return mean_ns > 0 ? chunk_size / (mean_ns / 1e9) / 1e6 : 0;
+    }
+
+    // Same measurement point in two result sets
+    bool same_cell(const RunRecord& other) const {
+        return source == other.source && chunk_size == other.chunk_size && config == other.config &&
+               threads == other.threads && repetition == other.repetition;
+    }
+};
+
+struct ResultSet {
+    EnvironmentInfo env;
+    std::vector<RunRecord> runs;
+};
+
+inline void save_results(const std::string& path, const ResultSet& results) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Failed to create results file " + path);
+    }
+
+    out << "rngbench-results " << RESULTS_FORMAT_VERSION << "\n"
+        << "kernel " << results.env.kernel << "\n"
+        << "cpu " << results.env.cpu << "\n"
+        << "modules " << results.env.modules << "\n"
+        << "created " << results.env.created << "\n";
+
+    for (const auto& run : results.runs) {
+        const auto& h = run.histogram;
+        out << "run " << run.source << " " << run.chunk_size << "\n";
+        if (!run.config.empty()) {
+            out << "cell " << run.config << " " << run.threads << " " << run.repetition << " " << std::fixed
+                << std::setprecision(3) << run.wall_us << " " << run.aggregate_throughput << std::defaultfloat << "\n";
+        }
+        out << "stats " << h.count() << " " << h.min() << " " << h.max() << " "
+            << std::fixed << std::setprecision(0) << h.sum() << std::defaultfloat << "\n"
+            << "histogram";
+        const auto& counts = h.counts();
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (counts[i]) out << " " << i << ":" << counts[i];
+        }
+        out << "\n";
+        if (!run.samples.empty()) {
+            out << "samples";
+            for (auto v : run.samples) out << " " << v;
+            out << "\n";
+        }
+        out << "end\n";
+    }
+
+    if (!out) {
+        throw std::runtime_error("Failed to write results file " + path);
+    }
+}
+
+inline ResultSet load_results(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Failed to open results file " + path);
+    }
+
+    std::string magic;
+    int version = 0;
+    if (!(in >> magic >> version) || magic != "rngbench-results") {
+        throw std::runtime_error(path + " is not a results file");
+    }
+    if (version < RESULTS_FORMAT_OLDEST || version > RESULTS_FORMAT_VERSION) {
+        throw std::runtime_error(path + ": unsupported results format version " + std::to_string(version));
+    }
+
+    ResultSet results;
+    RunRecord* run = nullptr;
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+        const auto space = line.find(' ');
+        const std::string key = line.substr(0, space);
+        const std::string rest = space == std::string::npos ? "" : line.substr(space + 1);
+        std::istringstream fields(rest);
+
+        if (key == "kernel") {
+            results.env.kernel = rest;
+        } else if (key == "cpu") {
+            results.env.cpu = rest;
+        } else if (key == "modules") {
+            results.env.modules = rest;
+        } else if (key == "created") {
+            results.env.created = rest;
+        } else if (key == "run") {
+            results.runs.emplace_back();
+            run = &results.runs.back();
+            fields >> run->source >> run->chunk_size;
+        } else if (key == "end") {
+            run = nullptr;
+        } else if (!run) {
+            throw std::runtime_error(path + ": '" + key + "' outside of a run");
+        } else if (key == "cell") {
+            fields >> run->config >> run->threads >> run->repetition;
+            if (version >= 3) fields >> run->wall_us >> run->aggregate_throughput;
+        } else if (key == "stats") {
+            uint64_t count, min, max;
+            long double sum;
+            fields >> count >> min >> max >> sum;
+            run->histogram.restore_totals(min, max, sum);
+        } else if (key == "histogram") {
+            std::string pair;
+            while (fields >> pair) {
+                const auto colon = pair.find(':');
+                run->histogram.record_bucket(std::stoul(pair.substr(0, colon)), std::stoull(pair.substr(colon + 1)));
+            }
+        } else if (key == "samples") {
+            uint64_t v;
+            while (fields >> v) run->samples.push_back(v);
+        } else if (!key.empty()) {
+            throw std::runtime_error(path + ": unknown record '" + key + "'");
+        }
+    }
+    return results;
+}
+
+enum class CompareStatus {
+    Ok,
+    Regression,   // a matched run got worse than the threshold
+    Incomplete,   // nothing matched, or baseline runs are missing from the candidate
+};
+
+// Prints a baseline/candidate table for the runs matched by (source, chunk
+// size and, for matrix runs, cell). A run more than max_regression_pct worse
+// in p99 latency or in throughput is a regression; a check that matched no
+// run or lost baseline runs proves nothing and is reported as incomplete.
+// Runs only in the candidate are new and just listed.
+inline CompareStatus compare_results(const ResultSet& baseline, const ResultSet& candidate,
+                                     double max_regression_pct) {
+    std::cout << "\n=== Regression Check (threshold " << max_regression_pct << " %) ===\n"
+              << "Baseline:  kernel " << baseline.env.kernel << ", " << baseline.env.created << "\n"
+              << "Candidate: kernel " << candidate.env.kernel << ", " << candidate.env.created << "\n";
+    if (baseline.env.cpu != candidate.env.cpu) {
+        std::cout << "Warning: CPU differs (" << baseline.env.cpu << " vs " << candidate.env.cpu << ")\n";
+    }
+    if (baseline.env.modules != candidate.env.modules) {
+        std::cout << "Note: loaded module sets differ\n";
+    }
+
+    std::cout << std::left << std::setw(28) << "Source" << std::setw(8) << "Chunk" << std::right
+              << std::setw(12) << "p99 base" << std::setw(12) << "p99 new" << std::setw(10) << "Δ%"
+              << std::setw(12) << "MB/s base" << std::setw(12) << "MB/s new" << std::setw(10) << "Δ%"
+              << "  Status\n";
+
+    bool regressed = false;
+    size_t matched = 0, new_runs = 0;
+    for (const auto& cand : candidate.runs) {
+        auto base = std::find_if(baseline.runs.begin(), baseline.runs.end(),
+                                 [&](const RunRecord& r) { return r.same_cell(cand); });
+        if (base == baseline.runs.end()) {
+            std::cout << std::left << std::setw(28) << cand.source << std::setw(8) << format_size(cand.chunk_size)
+                      << std::right << "  no baseline\n";
+            ++new_runs;
+            continue;
+        }
+        ++matched;
+
+        const double p99_base = base->histogram.value_at_percentile(99) / 1e3;
+        const double p99_new = cand.histogram.value_at_percentile(99) / 1e3;
+        const double tp_base = base->throughput();
+        const double tp_new = cand.throughput();
+        const double p99_change = p99_base > 0 ? 100.0 * (p99_new - p99_base) / p99_base : 0;
+        const double tp_change = tp_base > 0 ? 100.0 * (tp_new - tp_base) / tp_base : 0;
+        const bool bad = p99_change > max_regression_pct || tp_change < -max_regression_pct;
+        regressed |= bad;
+
+        std::cout << std::left << std::setw(28) << cand.source << std::setw(8) << format_size(cand.chunk_size)
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << p99_base << std::setw(12) << p99_new << std::setw(10) << p99_change
+                  << std::setw(12) << tp_base << std::setw(12) << tp_new << std::setw(10) << tp_change
+                  << std::defaultfloat << "  " << (bad ? "REGRESSION" : "ok") << "\n";
+    }
+
+    size_t missing = 0;
+    for (const auto& base : baseline.runs) {
+        const bool found = std::any_of(candidate.runs.begin(), candidate.runs.end(),
+                                       [&](const RunRecord& r) { return r.same_cell(base); });
+        if (!found) {
+            std::cout << std::left << std::setw(28) << base.source << std::setw(8) << format_size(base.chunk_size)
+                      << std::right << "  MISSING from candidate\n";
+            ++missing;
+        }
+    }
+
+    std::cout << matched << " runs compared, " << missing << " baseline runs missing, " << new_runs
+              << " new runs without baseline\n";
+    if (regressed) return CompareStatus::Regression;
+    if (matched == 0 || missing > 0) {
+        std::cout << "Regression check incomplete\n";
+        return CompareStatus::Incomplete;
+    }
+    return CompareStatus::Ok;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+// Accepts plain byte counts and K/M/G suffixes (powers of 1024)
+inline size_t parse_size(const std::string& text) {
+    size_t pos = 0;
+    unsigned long long value = std::stoull(text, &pos);
+    std::string suffix = text.substr(pos);
+    if (suffix.empty() || suffix == "B") return value;
+    if (suffix == "K" || suffix == "KB") return value * 1024;
+    if (suffix == "M" || suffix == "MB") return value * 1024 * 1024;
+    if (suffix == "G" || suffix == "GB") return value * 1024 * 1024 * 1024;
+    throw std::invalid_argument("Invalid size: " + text);
+}
+
+// Shortest exact representation, e.g. 8MB, 4KB, 1536B
+inline std::string format_size(size_t bytes) {
+    static const char* units[] = {"B", "KB", "MB", "GB"};
+    size_t unit = 0;
+    while (unit < 3 && bytes >= 1024 && bytes % 1024 == 0) {
+        bytes /= 1024;
+        ++unit;
+    }
+    std::ostringstream out;
+    out << bytes << units[unit];
+    return out.str();
+}
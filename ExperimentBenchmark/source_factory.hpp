@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include "entropy_source.hpp"
+#include "io_uring_source.hpp"
+
+// Tunables for backends that need more than a name
+struct SourceSettings {
+    unsigned uring_depth = 32;  // reads kept in flight
+    unsigned uring_batch = 8;   // SQEs per io_uring_enter
+    ChaChaReseedPolicy chacha;  // chacha-pool reseed policy
+};
+
+// Every backend name accepted on the command line, in reporting order.
+inline std::vector<std::string> available_entropy_sources() {
+    std::vector<std::string> names = {
+        "random",
+        "urandom",
+        "random-fd",
+        "urandom-fd",
+        "random-pread",
+        "urandom-pread",
+        "random-open-read",
+        "urandom-open-read",
+        "getrandom",
+        "getrandom-nonblock",
+        "getrandom-random",
+        "getrandom-random-nonblock",
+        "getrandom-insecure",
+        "getrandom-insecure-nonblock",
+        "getentropy",
+        "uring",
+        "uring-sqpoll",
+        "chacha-pool",
+        "chacha-pool-scalar",
+    };
+    if (VdsoGetrandomSource::available()) {
+        names.push_back("vdso-getrandom");
+    }
+    return names;
+}
+
+inline std::unique_ptr<EntropySource> make_entropy_source(const std::string& name,
+                                                          const SourceSettings& settings = {}) {
+    if (name == "random") return std::make_unique<DeviceStreamSource>(name, "/dev/random");
+    if (name == "urandom") return std::make_unique<DeviceStreamSource>(name, "/dev/urandom");
+    if (name == "random-fd") return std::make_unique<DeviceFdSource>(name, "/dev/random", DeviceFdSource::Mode::Read);
+    if (name == "urandom-fd") return std::make_unique<DeviceFdSource>(name, "/dev/urandom", DeviceFdSource::Mode::Read);
+    if (name == "random-pread") return std::make_unique<DeviceFdSource>(name, "/dev/random", DeviceFdSource::Mode::Pread);
+    if (name == "urandom-pread") return std::make_unique<DeviceFdSource>(name, "/dev/urandom", DeviceFdSource::Mode::Pread);
+    if (name == "random-open-read") return std::make_unique<DeviceFdSource>(name, "/dev/random", DeviceFdSource::Mode::OpenPerCall);
+    if (name == "urandom-open-read") return std::make_unique<DeviceFdSource>(name, "/dev/urandom", DeviceFdSource::Mode::OpenPerCall);
+    if (name == "getrandom") return std::make_unique<GetrandomSource>(name, 0);
+    if (name == "getrandom-nonblock") return std::make_unique<GetrandomSource>(name, GRND_NONBLOCK);
+    if (name == "getrandom-random") return std::make_unique<GetrandomSource>(name, GRND_RANDOM);
+    if (name == "getrandom-random-nonblock") return std::make_unique<GetrandomSource>(name, GRND_RANDOM | GRND_NONBLOCK);
+    if (name == "getrandom-insecure") return std::make_unique<GetrandomSource>(name, GRND_INSECURE);
+    if (name == "getrandom-insecure-nonblock") return std::make_unique<GetrandomSource>(name, GRND_INSECURE | GRND_NONBLOCK);
+    if (name == "getentropy") return std::make_unique<GetentropySource>();
+    if (name == "uring") return std::make_unique<IoUringSource>(name, settings.uring_depth, settings.uring_batch, false);
+    if (name == "uring-sqpoll") return std::make_unique<IoUringSource>(name, settings.uring_depth, settings.uring_batch, true);
+    if (name == "chacha-pool") return std::make_unique<ChaChaPoolSource>(name, settings.chacha, true);
+    if (name == "chacha-pool-scalar") return std::make_unique<ChaChaPoolSource>(name, settings.chacha, false);
+    if (name == "vdso-getrandom") return std::make_unique<VdsoGetrandomSource>();
+    throw std::invalid_argument("Unknown entropy source: " + name);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include "ab_statistics.hpp"
+
+// Steady-state analysis of a single latency series: where warmup ends, how
+// precise the steady-state mean is, and which samples are outliers.
+
+// Two-sided 95% Student t quantile; exact table up to 30 degrees of freedom
+inline double t_critical_95(size_t df) {
+    static const double table[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    if (df == 0) return INFINITY;
+    return df <= 30 ? table[df] : 1.96 + 2.4 / df;
+}
+
+// MSER-5 warmup truncation (White, 1997): average the series in batches of
+// five and drop the prefix of d batches that minimises the standard error of
+// what remains, searching only the first half. Returns the number of samples
+// to discard.
+inline size_t mser5_truncation(const std::vector<double>& samples) {
+    constexpr size_t BATCH = 5;
+    const size_t k = samples.size() / BATCH;
+    if (k < 4) return 0;
+
+    std::vector<double> batches(k);
+    for (size_t j = 0; j < k; ++j) {
+        batches[j] = std::accumulate(samples.begin() + j * BATCH, samples.begin() + (j + 1) * BATCH, 0.0) / BATCH;
+    }
+
+    // Suffix sums let every candidate cut be evaluated in O(1)
+    std::vector<double> sum(k + 1, 0.0), sum_sq(k + 1, 0.0);
+    for (size_t j = k; j-- > 0;) {
+        sum[j] = sum[j + 1] + batches[j];
+        sum_sq[j] = sum_sq[j + 1] + batches[j] * batches[j];
+    }
+
+    size_t best = 0;
+    double best_score = INFINITY;
+    for (size_t d = 0; d <= k / 2; ++d) {
+        const double n = static_cast<double>(k - d);
+        const double sse = sum_sq[d] - sum[d] * sum[d] / n;
+        const double score = sse / (n * n);
+        if (score < best_score) {
+            best_score = score;
+            best = d;
+        }
+    }
+    return best * BATCH;
+}
+
+// 95% CI of the mean of samples[begin..) by non-overlapping batch means, which
+// stays valid when consecutive iterations are correlated (they usually are).
+inline ConfidenceInterval batch_means_ci(const std::vector<double>& samples, size_t begin, size_t batches = 20) {
+    ConfidenceInterval ci;
+    const size_t n = samples.size() > begin ? samples.size() - begin : 0;
+    if (n == 0) return ci;
+
+    ci.estimate = std::accumulate(samples.begin() + begin, samples.end(), 0.0) / n;
+    batches = std::min(batches, n / 2);
+    if (batches < 2) {
+        ci.lower = -INFINITY;
+        ci.upper = INFINITY;
+        return ci;
+    }
+
+    const size_t size = n / batches;
+    std::vector<double> means(batches);
+    for (size_t j = 0; j < batches; ++j) {
+        auto first = samples.begin() + begin + j * size;
+        means[j] = std::accumulate(first, first + size, 0.0) / size;
+    }
+    const double m = sample_mean(means);
+    double var = 0;
+    for (double x : means) var += (x - m) * (x - m);
+    var /= batches - 1;
+
+    const double half = t_critical_95(batches - 1) * std::sqrt(var / batches);
+    ci.lower = ci.estimate - half;
+    ci.upper = ci.estimate + half;
+    return ci;
+}
+
+// Indices in samples[begin..) whose modified z-score (Iglewicz & Hoaglin,
+// based on the median absolute deviation) exceeds `threshold`.
+inline std::vector<size_t> flag_outliers(const std::vector<double>& samples, size_t begin,
+                                         double threshold = 3.5) {
+    std::vector<size_t> outliers;
+    if (samples.size() <= begin + 2) return outliers;
+
+    std::vector<double> tail(samples.begin() + begin, samples.end());
+    const double median = sample_median(tail);
+    for (auto& x : tail) x = std::fabs(x - median);
+    const double mad = sample_median(tail);
+    if (mad == 0) return outliers;
+
+    for (size_t i = begin; i < samples.size(); ++i) {
+        if (0.6745 * std::fabs(samples[i] - median) / mad > threshold) {
+            outliers.push_back(i);
+        }
+    }
+    return outliers;
+}
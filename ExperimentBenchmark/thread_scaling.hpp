@@ -0,0 +1,323 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include "source_factory.hpp"
+#include "graph_plotter.hpp"
+#include "latency_histogram.hpp"
+#include "perf_counters.hpp"
+#include "precision_clock.hpp"
+
+// CPUs this process may run on, in ascending order
+inline std::vector<int> allowed_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        throw std::runtime_error(std::string("sched_getaffinity failed: ") + std::strerror(errno));
+    }
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// NUMA node of a CPU, read from the nodeN link in sysfs; 0 if unknown
+inline int numa_node_of(int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return 0;
+
+    int node = 0;
+    while (struct dirent* ent = readdir(dir)) {
+        if (std::strncmp(ent->d_name, "node", 4) == 0 && std::isdigit(ent->d_name[4])) {
+            node = std::atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// Runs 1..N reader threads, each pinned to its own CPU (round-robin over the
+// affinity mask), released together through a barrier. Every thread owns its
+// entropy source, buffer and timing vector so nothing is shared while timing.
+class ThreadScalingBenchmark {
+public:
+    struct ThreadResult {
+        int cpu = 0;
+        int node = 0;
+        std::vector<double> timings;  // µs per read
+        double throughput = 0;        // MB/s seen by this thread
+        LatencyHistogram histogram;   // ns, every call
+        PerfCounterLog perf;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point finished;
+    };
+
+    struct StepResult {
+        size_t threads = 0;
+        double wall_us = 0;
+        double aggregate_throughput = 0;  // MB/s over all threads
+        double fairness = 0;              // Jain's index, 1.0 = perfectly fair
+        LatencyHistogram histogram;       // all threads merged
+        PerfCounterLog perf;
+        std::vector<ThreadResult> per_thread;
+    };
+
+    ThreadScalingBenchmark(std::string source, size_t num_experiments, size_t chunk_size, size_t max_threads,
+                           const SourceSettings& settings = {})
+        : source_(std::move(source)),
+          settings_(settings),
+          NUM_EXPERIMENTS(num_experiments),
+          CHUNK_SIZE(chunk_size),
+          MAX_THREADS(max_threads),
+          cpus_(allowed_cpus()) {}
+
+    // Every reader thread opens its own counter group
+    void enable_perf_counters() { perf_enabled_ = true; }
+    void use_clock(const PrecisionClock& clock) { clock_ = &clock; }
+
+    void run() {
+        std::cout << "Starting " << source_ << " scaling benchmark: 1.." << MAX_THREADS
+                  << " threads on " << cpus_.size() << " CPUs, " << NUM_EXPERIMENTS
+                  << " reads of " << CHUNK_SIZE << " bytes per thread\n";
+
+        for (size_t threads = 1; threads <= MAX_THREADS; ++threads) {
+            steps_.push_back(run_step(threads));
+            print_step(steps_.back());
+        }
+
+        analyze_results();
+    }
+
+    // One step at a fixed thread count, without the 1..N sweep or the report
+    StepResult measure(size_t threads) { return run_step(threads); }
+
+    const std::string& source_name() const { return source_; }
+    const std::vector<StepResult>& steps() const { return steps_; }
+
+    // Adds the throughput-vs-threads curve for this source to a plotter
+    void add_scaling_graphs(GraphPlotter& plotter) const {
+        std::vector<std::pair<double, double>> curve;
+        std::vector<std::pair<double, double>> ideal;
+        for (const auto& step : steps_) {
+            curve.emplace_back(step.threads, step.aggregate_throughput);
+            ideal.emplace_back(step.threads, steps_.front().aggregate_throughput * step.threads);
+        }
+        plotter.addGraph(source_ + " aggregate", std::move(curve));
+        plotter.addGraph(source_ + " linear scaling", std::move(ideal));
+    }
+
+    // Adds average latency per CPU of the widest step
+    void add_per_core_graph(GraphPlotter& plotter) const {
+        std::vector<std::pair<double, double>> points;
+        for (const auto& [cpu, avg] : per_core_latency(steps_.back())) {
+            points.emplace_back(cpu, avg);
+        }
+        plotter.addGraph(source_ + " per-core latency", std::move(points));
+    }
+
+private:
+    const std::string source_;
+    const SourceSettings settings_;
+    const size_t NUM_EXPERIMENTS;
+    const size_t CHUNK_SIZE;
+    const size_t MAX_THREADS;
+    std::vector<int> cpus_;
+    std::vector<StepResult> steps_;
+    bool perf_enabled_ = false;
+    const PrecisionClock* clock_ = &PrecisionClock::instance();
+
+    StepResult run_step(size_t threads) {
+        StepResult step;
+        step.threads = threads;
+        step.per_thread.resize(threads);
+
+        // Sources are created up front so construction failures surface here
+        // and not inside a worker thread.
+        std::vector<std::unique_ptr<EntropySource>> sources;
+        for (size_t i = 0; i < threads; ++i) {
+            sources.push_back(make_entropy_source(source_, settings_));
+        }
+
+        // Likewise the buffers: a worker that throws before the barrier would
+        // leave every other thread waiting at it
+        std::vector<std::vector<char>> buffers;
+        for (size_t i = 0; i < threads; ++i) {
+            buffers.emplace_back(CHUNK_SIZE);
+            step.per_thread[i].timings.reserve(NUM_EXPERIMENTS);
+        }
+
+        pthread_barrier_t barrier;
+        pthread_barrier_init(&barrier, nullptr, static_cast<unsigned>(threads + 1));
+
+        std::vector<std::thread> workers;
+        std::vector<std::string> errors(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            ThreadResult& result = step.per_thread[i];
+            result.cpu = cpus_[i % cpus_.size()];
+            result.node = numa_node_of(result.cpu);
+            workers.emplace_back([&, i]() {
+                try {
+                    reader_thread(*sources[i], buffers[i], result, barrier);
+                } catch (const std::exception& e) {
+                    errors[i] = e.what();
+                }
+            });
+        }
+
+        pthread_barrier_wait(&barrier);
+        for (auto& worker : workers) worker.join();
+        pthread_barrier_destroy(&barrier);
+
+        for (const auto& error : errors) {
+            if (!error.empty()) throw std::runtime_error(error);
+        }
+
+        // Wall time spans the first thread leaving the barrier to the last one finishing
+        auto start = step.per_thread.front().started;
+        auto end = step.per_thread.front().finished;
+        for (const auto& t : step.per_thread) {
+            start = std::min(start, t.started);
+            end = std::max(end, t.finished);
+        }
+        step.wall_us = std::chrono::duration<double, std::micro>(end - start).count();
+        const double total_bytes = static_cast<double>(CHUNK_SIZE) * NUM_EXPERIMENTS * threads;
+        step.aggregate_throughput = total_bytes / (step.wall_us / 1e6) / 1e6;
+
+        double sum = 0, sum_sq = 0;
+        for (const auto& t : step.per_thread) {
+            step.histogram.merge(t.histogram);
+            step.perf.merge(t.perf);
+            sum += t.throughput;
+            sum_sq += t.throughput * t.throughput;
+        }
+        step.fairness = sum_sq > 0 ? (sum * sum) / (threads * sum_sq) : 0;
+        return step;
+    }
+
+    void reader_thread(EntropySource& source, std::vector<char>& buffer, ThreadResult& result,
+                       pthread_barrier_t& barrier) {
+        // A failed pin is not fatal, but the barrier must always be reached
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(result.cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+        // The counters count the thread that opens them, so they are set up
+        // here; a failure is reported only once past the barrier
+        std::unique_ptr<PerfCounterGroup> perf;
+        std::exception_ptr setup_error;
+        if (perf_enabled_) {
+            try {
+                perf = std::make_unique<PerfCounterGroup>();
+                result.perf.set_supported(*perf);
+            } catch (...) {
+                setup_error = std::current_exception();
+            }
+        }
+
+        pthread_barrier_wait(&barrier);
+        if (setup_error) std::rethrow_exception(setup_error);
+        result.started = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < NUM_EXPERIMENTS; ++i) {
+            PerfCounterGroup::Values before{};
+            if (perf) before = perf->read_values();
+            const uint64_t start = clock_->start();
+            source.fill(buffer.data(), CHUNK_SIZE);
+            const uint64_t end = clock_->stop();
+            if (perf) result.perf.record(before, perf->read_values(), false);
+            const uint64_t ns = clock_->elapsed_ns(start, end);
+            result.histogram.record(ns);
+            result.timings.push_back(ns / 1e3);
+        }
+        result.finished = std::chrono::steady_clock::now();
+
+        const double total_us = std::accumulate(result.timings.begin(), result.timings.end(), 0.0);
+        result.throughput = total_us > 0 ? CHUNK_SIZE * NUM_EXPERIMENTS / (total_us / 1e6) / 1e6 : 0;
+    }
+
+    static std::map<int, double> per_core_latency(const StepResult& step) {
+        std::map<int, std::pair<double, size_t>> sums;
+        for (const auto& t : step.per_thread) {
+            auto& [sum, count] = sums[t.cpu];
+            sum += std::accumulate(t.timings.begin(), t.timings.end(), 0.0);
+            count += t.timings.size();
+        }
+        std::map<int, double> averages;
+        for (const auto& [cpu, sc] : sums) {
+            averages[cpu] = sc.second ? sc.first / sc.second : 0;
+        }
+        return averages;
+    }
+
+    void print_step(const StepResult& step) {
+        const auto [slowest, fastest] = std::minmax_element(step.per_thread.begin(), step.per_thread.end(),
+            [](const ThreadResult& a, const ThreadResult& b) { return a.throughput < b.throughput; });
+        std::cout << std::setw(3) << step.threads << " threads: "
+                  << step.aggregate_throughput << " MB/s aggregate, "
+                  << "fairness " << step.fairness
+                  << ", per-thread " << slowest->throughput << ".." << fastest->throughput << " MB/s"
+                  << ", p50/p99/p99.9 " << step.histogram.value_at_percentile(50) / 1e3
+                  << "/" << step.histogram.value_at_percentile(99) / 1e3
+                  << "/" << step.histogram.value_at_percentile(99.9) / 1e3 << " µs\n";
+        if (step.perf.calls()) {
+            std::cout << "     per call:";
+            for (size_t i = 0; i < PerfCounterGroup::COUNTER_COUNT; ++i) {
+                if (!step.perf.supported(i)) continue;
+                std::cout << " " << PerfCounterGroup::counter_name(i) << "=" << step.perf.per_call(i);
+            }
+            std::cout << "\n";
+        }
+    }
+
+    void analyze_results() {
+        const StepResult& widest = steps_.back();
+        const double base = steps_.front().aggregate_throughput;
+
+        std::cout << "\n=== Scaling Results (" << source_ << ") ===\n"
+                  << std::setw(8) << "Threads" << std::setw(16) << "MB/s"
+                  << std::setw(12) << "Speedup" << std::setw(12) << "Fairness"
+                  << std::setw(12) << "p99 (µs)" << std::setw(14) << "p99.99 (µs)" << "\n";
+        for (const auto& step : steps_) {
+            std::cout << std::setw(8) << step.threads
+                      << std::setw(16) << step.aggregate_throughput
+                      << std::setw(12) << (base > 0 ? step.aggregate_throughput / base : 0)
+                      << std::setw(12) << step.fairness
+                      << std::setw(12) << step.histogram.value_at_percentile(99) / 1e3
+                      << std::setw(14) << step.histogram.value_at_percentile(99.99) / 1e3 << "\n";
+        }
+
+        std::cout << "\nPer-core latency at " << widest.threads << " threads:\n";
+        std::map<int, std::pair<double, size_t>> per_node;
+        for (const auto& t : widest.per_thread) {
+            auto& [sum, count] = per_node[t.node];
+            sum += std::accumulate(t.timings.begin(), t.timings.end(), 0.0);
+            count += t.timings.size();
+        }
+        for (const auto& [cpu, avg] : per_core_latency(widest)) {
+            std::cout << "  CPU " << std::setw(3) << cpu << " (node " << numa_node_of(cpu) << "): "
+                      << avg << " µs\n";
+        }
+        for (const auto& [node, sc] : per_node) {
+            std::cout << "  Node " << node << " average: " << (sc.second ? sc.first / sc.second : 0) << " µs\n";
+        }
+    }
+};
@@ -0,0 +1,302 @@
+/*
+ * Runtime-tunable delay injection shared by the hook modules.
+ *
+ * Every knob is a module parameter with mode 0644, so it can be given at
+ * insmod time and changed later through /sys/module/<module>/parameters/
+ * without reloading:
+ *
+ *   delay_mode       off | fixed | uniform | exponential | spikes
+ *   delay_us         fixed: the delay; uniform: upper bound;
+ *                    exponential: the mean; spikes: the spike height
+ *   delay_min_us     uniform: lower bound
+ *   delay_max_us     exponential: cap on a single delay (0 = none)
+ *   spike_period     spikes: every Nth call is delayed
+ *   delay_permille   probability of delaying a call, 0..1000
+ *   target_pid       only delay this process (tgid), 0 = all
+ *   target_comm      only delay tasks with this comm, empty = all
+ *   delay_sleep      sleep with usleep_range() instead of spinning when
+ *                    the hook runs in a context that may sleep
+ *
+ * The defaults reproduce the original behaviour: a 50 ms busy-wait on
+ * every call. Include this header from exactly one file per module.
+ */
+#ifndef RNG_DELAY_H
+#define RNG_DELAY_H
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/delay.h>
+#include <linux/percpu.h>
+#include <linux/prandom.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/atomic.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+
+enum rng_delay_mode {
+    RNG_DELAY_OFF,
+    RNG_DELAY_FIXED,
+    RNG_DELAY_UNIFORM,
+    RNG_DELAY_EXPONENTIAL,
+    RNG_DELAY_SPIKES,
+};
+
+static const char * const rng_delay_mode_names[] = {
+    "off", "fixed", "uniform", "exponential", "spikes",
+};
+
+static int delay_mode = RNG_DELAY_FIXED;
+static unsigned int delay_us = 50000;
+static unsigned int delay_min_us;
+static unsigned int delay_max_us;
+static unsigned int spike_period = 100;
+static unsigned int delay_permille = 1000;
+static int target_pid;
+static char target_comm[TASK_COMM_LEN];
+static bool delay_sleep;
+
+static int delay_mode_set(const char *val, const struct kernel_param *kp)
+{
+    int mode = sysfs_match_string(rng_delay_mode_names, val);
+
+    if (mode < 0)
+        return -EINVAL;
+    WRITE_ONCE(delay_mode, mode);
+    return 0;
+}
+
+static int delay_mode_get(char *buffer, const struct kernel_param *kp)
+{
+    return sysfs_emit(buffer, "%s\n", rng_delay_mode_names[READ_ONCE(delay_mode)]);
+}
+
+static const struct kernel_param_ops delay_mode_ops = {
+    .set = delay_mode_set,
+    .get = delay_mode_get,
+};
+
+module_param_cb(delay_mode, &delay_mode_ops, NULL, 0644);
+MODULE_PARM_DESC(delay_mode, "off, fixed, uniform, exponential or spikes (default fixed)");
+module_param(delay_us, uint, 0644);
+MODULE_PARM_DESC(delay_us, "Delay, upper bound, mean or spike height in us (default 50000)");
+module_param(delay_min_us, uint, 0644);
+MODULE_PARM_DESC(delay_min_us, "Lower bound of the uniform distribution in us");
+module_param(delay_max_us, uint, 0644);
+MODULE_PARM_DESC(delay_max_us, "Cap on one exponential delay in us, 0 = none");
+module_param(spike_period, uint, 0644);
+MODULE_PARM_DESC(spike_period, "Spikes mode: delay every Nth call (default 100)");
+module_param(delay_permille, uint, 0644);
+MODULE_PARM_DESC(delay_permille, "Probability of delaying a call in 1/1000 (default 1000)");
+module_param(target_pid, int, 0644);
+MODULE_PARM_DESC(target_pid, "Only delay this process, 0 = all");
+module_param_string(target_comm, target_comm, sizeof(target_comm), 0644);
+MODULE_PARM_DESC(target_comm, "Only delay tasks with this name, empty = all");
+module_param(delay_sleep, bool, 0644);
+MODULE_PARM_DESC(delay_sleep, "Sleep instead of spinning where the hook context allows it");
+
+/*
+ * Counters, read-only through the same parameters directory
+ */
+static DEFINE_PER_CPU(unsigned long, rng_delay_applied);
+static DEFINE_PER_CPU(unsigned long, rng_delay_slept);
+static DEFINE_PER_CPU(u64, rng_delay_total_ns);
+
+static int delay_counter_get(char *buffer, const struct kernel_param *kp)
+{
+    const unsigned long __percpu *counter = kp->arg;
+    unsigned long sum = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        sum += *per_cpu_ptr(counter, cpu);
+    return sysfs_emit(buffer, "%lu\n", sum);
+}
+
+static int delay_total_get(char *buffer, const struct kernel_param *kp)
+{
+    u64 sum = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        sum += *per_cpu_ptr(&rng_delay_total_ns, cpu);
+    return sysfs_emit(buffer, "%llu\n", sum);
+}
+
+static const struct kernel_param_ops delay_counter_ops = {
+    .get = delay_counter_get,
+};
+
+static const struct kernel_param_ops delay_total_ops = {
+    .get = delay_total_get,
+};
+
+module_param_cb(delays_applied, &delay_counter_ops, &rng_delay_applied, 0444);
+MODULE_PARM_DESC(delays_applied, "Calls that were delayed");
+module_param_cb(delays_slept, &delay_counter_ops, &rng_delay_slept, 0444);
+MODULE_PARM_DESC(delays_slept, "Delays taken by sleeping instead of spinning");
+module_param_cb(delay_total_ns, &delay_total_ops, NULL, 0444);
+MODULE_PARM_DESC(delay_total_ns, "Sum of all injected delays in ns");
+
+static DEFINE_PER_CPU(struct rnd_state, rng_delay_rnd);
+static atomic64_t rng_delay_calls = ATOMIC64_INIT(0);
+
+/*
+ * Seeds the per-CPU generators; call from module init. The distributions
+ * use prandom, never the crng, so a delay cannot recurse into a hooked
+ * RNG entry point.
+ */
+static void rng_delay_init(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        prandom_seed_state(per_cpu_ptr(&rng_delay_rnd, cpu), get_random_u64());
+}
+
+/*
+ * log2(x) in 16.16 fixed point for x >= 1, by repeated squaring of the
+ * mantissa normalised to [1, 2) in Q1.31
+ */
+static u32 rng_delay_log2_q16(u32 x)
+{
+    u32 result = (u32)ilog2(x) << 16;
+    u64 m = (u64)x << (31 - ilog2(x));
+    int bit;
+
+    for (bit = 15; bit >= 0; bit--) {
+        m = (m * m) >> 31;
+        if (m >= (2ULL << 31)) {
+            m >>= 1;
+            result |= 1U << bit;
+        }
+    }
+    return result;
+}
+
+/*
+ * Exponential sample with the given mean: mean * -ln(U), U uniform in
+ * (0, 1], in integer arithmetic (ln 2 = 45426 / 2^16)
+ */
+static u64 rng_delay_exponential_ns(u64 mean_ns, u32 r)
+{
+    u32 u = r ? r : 1;
+    u64 neg_log2 = (32ULL << 16) - rng_delay_log2_q16(u);  // -log2(u / 2^32), Q16
+    u32 neg_ln = (u32)((neg_log2 * 45426) >> 16);          // Q16, at most ~22.2
+
+    return mul_u64_u32_shr(mean_ns, neg_ln, 16);
+}
+
+static bool rng_delay_targets_current(void)
+{
+    int pid = READ_ONCE(target_pid);
+
+    if (pid && task_tgid_nr(current) != pid)
+        return false;
+    // A write racing with this read can only make one call match wrongly
+    if (target_comm[0] && strncmp(current->comm, target_comm, TASK_COMM_LEN) != 0)
+        return false;
+    return true;
+}
+
+/*
+ * Delay for this call in ns, 0 if it is not delayed
+ */
+static u64 rng_delay_pick_ns(void)
+{
+    int mode = READ_ONCE(delay_mode);
+    unsigned int permille = READ_ONCE(delay_permille);
+    u64 base = (u64)READ_ONCE(delay_us) * NSEC_PER_USEC;
+    struct rnd_state *rnd;
+    u64 ns = 0;
+    u32 r1, r2;
+
+    if (mode == RNG_DELAY_OFF || !rng_delay_targets_current())
+        return 0;
+
+    rnd = get_cpu_ptr(&rng_delay_rnd);
+    r1 = prandom_u32_state(rnd);
+    r2 = prandom_u32_state(rnd);
+    put_cpu_ptr(&rng_delay_rnd);
+
+    if (permille < 1000 && r1 % 1000 >= permille)
+        return 0;
+
+    switch (mode) {
+    case RNG_DELAY_FIXED:
+        ns = base;
+        break;
+    case RNG_DELAY_UNIFORM: {
+        u64 low = (u64)READ_ONCE(delay_min_us) * NSEC_PER_USEC;
+
+        ns = base > low ? low + mul_u64_u32_shr(base - low, r2, 32) : base;
+        break;
+    }
+    case RNG_DELAY_EXPONENTIAL: {
+        u64 cap = (u64)READ_ONCE(delay_max_us) * NSEC_PER_USEC;
+
+        ns = rng_delay_exponential_ns(base, r2);
+        if (cap && ns > cap)
+            ns = cap;
+        break;
+    }
+    case RNG_DELAY_SPIKES: {
+        unsigned int period = READ_ONCE(spike_period);
+
+        if (period && atomic64_inc_return(&rng_delay_calls) % period == 0)
+            ns = base;
+        break;
+    }
+    }
+    return ns;
+}
+
+/*
+ * Busy-waits in the largest steps that stay accurate: ndelay below a
+ * microsecond, udelay up to a millisecond, mdelay beyond.
+ */
+static void rng_delay_spin(u64 ns)
+{
+    u64 us = div64_u64(ns, NSEC_PER_USEC);
+
+    if (us == 0) {
+        ndelay(ns);
+        return;
+    }
+    if (us >= 1000) {
+        mdelay(div64_u64(us, 1000));
+        us %= 1000;
+    }
+    if (us)
+        udelay(us);
+}
+
+/*
+ * Applies the configured delay to the current call. may_sleep says the
+ * hook itself runs in process context (not in a kprobe/ftrace handler);
+ * sleeping then also requires preemptible(), which is false in atomic
+ * sections and on kernels without preempt counting.
+ */
+static void rng_delay_apply(bool may_sleep)
+{
+    u64 ns = rng_delay_pick_ns();
+
+    if (!ns)
+        return;
+
+    this_cpu_inc(rng_delay_applied);
+    this_cpu_add(rng_delay_total_ns, ns);
+
+    if (READ_ONCE(delay_sleep) && may_sleep && preemptible() && ns >= 10 * NSEC_PER_USEC) {
+        unsigned long us = (unsigned long)div64_u64(ns, NSEC_PER_USEC);
+
+        this_cpu_inc(rng_delay_slept);
+        usleep_range(us, us + us / 10 + 1);
+        return;
+    }
+    rng_delay_spin(ns);
+}
+
+#endif /* RNG_DELAY_H */
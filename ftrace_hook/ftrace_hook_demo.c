@@ -10,71 +10,385 @@
 #include <linux/ptrace.h>
 #include <linux/kprobes.h>
 #include <linux/delay.h>
+#include <linux/fs.h>
+#include <linux/uio.h>
+#include <linux/sched/signal.h>
+#include <linux/percpu.h>
+#include <linux/preempt.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/timekeeping.h>
+#include <linux/rcupdate.h>
+#include "rng_delay.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("kapusha");
-MODULE_DESCRIPTION("Ftrace hook demo for get_random_bytes_user");
+MODULE_DESCRIPTION("Ftrace hook demo for the kernel RNG entry points");
+
+/*
+ * What the hook does with a call, switchable at runtime through
+ * /sys/module/ftrace_hook_demo/parameters/hook_mode:
+ *
+ *   passthrough  apply the delay, then run the real function and time it
+ *   fastfill     apply the delay, then fill the buffer from a seeded
+ *                counter-based generator instead of the crng
+ *
+ * Fast-fill output is a pure function of fill_seed and the position in the
+ * stream, so a single reader sees the same bytes on every run with the
+ * same seed. Writing fill_seed restarts the stream. Only the targets that
+ * hand out user buffers through an iov_iter are ever fast-filled; kernel
+ * consumers of get_random_bytes() always get the real thing.
+ */
+enum hook_mode {
+    HOOK_PASSTHROUGH,
+    HOOK_FASTFILL,
+};
+
+static const char * const hook_mode_names[] = {
+    "passthrough", "fastfill",
+};
+
+static int hook_mode = HOOK_PASSTHROUGH;
+static unsigned long long fill_seed = 0x853c49e6748fea9bULL;
+static atomic64_t fill_position = ATOMIC64_INIT(0);  // in 8-byte words
+
+/*
+ * Entry points to hook, comma separated, or "all". Fixed at load time: the
+ * ftrace filter is set up once in init.
+ */
+static char *targets = "get_random_bytes_user";
+
+static int hook_mode_set(const char *val, const struct kernel_param *kp)
+{
+    int mode = sysfs_match_string(hook_mode_names, val);
+
+    if (mode < 0)
+        return -EINVAL;
+    WRITE_ONCE(hook_mode, mode);
+    return 0;
+}
+
+static int hook_mode_get(char *buffer, const struct kernel_param *kp)
+{
+    return sysfs_emit(buffer, "%s\n", hook_mode_names[READ_ONCE(hook_mode)]);
+}
+
+static const struct kernel_param_ops hook_mode_ops = {
+    .set = hook_mode_set,
+    .get = hook_mode_get,
+};
+
+static int fill_seed_set(const char *val, const struct kernel_param *kp)
+{
+    int ret = param_set_ullong(val, kp);
+
+    if (!ret)
+        atomic64_set(&fill_position, 0);
+    return ret;
+}
+
+static const struct kernel_param_ops fill_seed_ops = {
+    .set = fill_seed_set,
+    .get = param_get_ullong,
+};
+
+module_param_cb(hook_mode, &hook_mode_ops, NULL, 0644);
+MODULE_PARM_DESC(hook_mode, "passthrough or fastfill (default passthrough)");
+module_param_cb(fill_seed, &fill_seed_ops, &fill_seed, 0644);
+MODULE_PARM_DESC(fill_seed, "Seed of the fastfill stream; writing it restarts the stream");
+module_param(targets, charp, 0444);
+MODULE_PARM_DESC(targets, "Comma separated entry points to hook or \"all\" (default get_random_bytes_user)");
+
+/*
+ * Hook targets. Each one has a replacement with the target's exact
+ * signature; the ftrace callback sends the call there and the replacement
+ * calls the original through addr.
+ */
+enum hook_target_id {
+    TARGET_GET_RANDOM_BYTES,
+    TARGET_GET_RANDOM_BYTES_USER,
+    TARGET_URANDOM_READ_ITER,
+    TARGET_RANDOM_READ_ITER,
+    TARGET_SYS_GETRANDOM,
+    NR_TARGETS,
+};
+
+struct hook_target {
+    const char *name;       // symbol; also the name accepted in targets=
+    void *replacement;
+    unsigned long addr;     // resolved address, 0 when not hooked
+};
+
+static struct hook_target hook_targets[NR_TARGETS];
+
+/*
+ * The fentry call sits at the symbol address, or right after an endbr64
+ * on kernels built with IBT; this is how far from the symbol the ftrace
+ * ip of a target may be.
+ */
+#define HOOK_IP_RANGE 16
+
+/*
+ * Per-CPU statistics for each target, shown in debugfs ftrace_hook_demo/stats
+ */
+struct hook_cpu_stats {
+    u64 calls;
+    u64 passthrough_calls;
+    u64 passthrough_ns;     // time spent in the real function
+    u64 fastfill_calls;
+    u64 bytes;
+    u64 errors;
+};
+
+static DEFINE_PER_CPU(struct hook_cpu_stats, hook_stats[NR_TARGETS]);
+static atomic_t hook_active = ATOMIC_INIT(0);  // calls inside a replacement
+static struct dentry *debug_dir;
 
 /*
  * Workaround to get kallsyms_lookup_name address since it's not always exported.
- * Uses kprobe technique to dynamically find the symbol address.
+ * Uses kprobe technique to dynamically find the symbol address; the kprobe is
+ * registered only on the first lookup and the address is cached after that.
  */
 static unsigned long my_kallsyms_lookup_name(const char *name)
 {
-    static struct kprobe kp = {
-        .symbol_name = "kallsyms_lookup_name"
-    };
+    static unsigned long (*real_kallsyms_lookup_name)(const char *name);
 
-    unsigned long (*real_kallsyms_lookup_name)(const char *name);
-    int ret;
+    if (!real_kallsyms_lookup_name) {
+        struct kprobe kp = {
+            .symbol_name = "kallsyms_lookup_name"
+        };
 
-    // Register temporary kprobe to get the address
-    ret = register_kprobe(&kp);
-    if (ret < 0)
-        return 0;
+        // Register temporary kprobe to get the address
+        if (register_kprobe(&kp) < 0)
+            return 0;
 
-    // Save the actual function address
-    real_kallsyms_lookup_name = (void *)kp.addr;
+        // Save the actual function address
+        real_kallsyms_lookup_name = (void *)kp.addr;
 
-    // Clean up the kprobe
-    unregister_kprobe(&kp);
+        // Clean up the kprobe
+        unregister_kprobe(&kp);
+    }
 
     // Call the real function to lookup our target symbol
     return real_kallsyms_lookup_name(name);
 }
 
-// Pointer to store the original get_random_bytes function
-static void (*real_get_random_bytes)(void *buf, int nbytes);
+/*
+ * Word i of the fast-fill stream: SplitMix64 of seed + (i + 1) * golden
+ * ratio. Counter-based, so any range of the stream can be produced
+ * without the words before it.
+ */
+static inline u64 fill_word(u64 seed, u64 index)
+{
+    u64 z = seed + (index + 1) * 0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
 
 /*
- * Our replacement function for get_random_bytes.
- * This will be called instead of the original function.
+ * Fills the iterator from the fast-fill stream. Each call reserves its
+ * range of the stream up front, so concurrent readers get disjoint slices.
+ * Mirrors get_random_bytes_user(): stops early on a pending signal and
+ * returns -EFAULT only when nothing could be copied.
  */
-void my_get_random_bytes(void *buf, int nbytes)
+static ssize_t fast_fill(struct iov_iter *iter)
 {
-    // Artificial delay to simulate processing 50ms
-    mdelay(50);
+    u64 block[32];
+    size_t total = iov_iter_count(iter);
+    size_t words = DIV_ROUND_UP(total, sizeof(u64));
+    u64 seed = READ_ONCE(fill_seed);
+    u64 index = atomic64_fetch_add(words, &fill_position);
+    ssize_t ret = 0;
+
+    if (!total)
+        return 0;
+
+    while (iov_iter_count(iter)) {
+        size_t chunk = min_t(size_t, iov_iter_count(iter), sizeof(block));
+        size_t copied;
+        int i;
+
+        for (i = 0; i < DIV_ROUND_UP(chunk, sizeof(u64)); i++)
+            block[i] = fill_word(seed, index++);
 
-    // Log that our function was called
-    pr_info("my_get_random_bytes called instead (ftrace)!\n");
+        copied = copy_to_iter(block, chunk, iter);
+        ret += copied;
+        if (copied != chunk)
+            break;
+
+        if (ret % PAGE_SIZE == 0) {
+            if (signal_pending(current))
+                break;
+            cond_resched();
+        }
+    }
+    memzero_explicit(block, sizeof(block));
+    return ret ? ret : -EFAULT;
 }
 
 /*
- * Ftrace callback function that gets executed when hooked function is called.
+ * Bookkeeping shared by the replacements: hook_begin() counts the call,
+ * applies the delay and says whether to fast-fill; hook_end() records the
+ * outcome. A target nested in another hooked one (getrandom calls
+ * get_random_bytes_user) is counted, and delayed, at both levels.
+ *
+ * get_random_bytes() is also called from interrupts, which may arrive in
+ * the middle of a hooked call on the same CPU: the counters are only
+ * updated with this_cpu ops, and interrupt-context calls are counted but
+ * never delayed, since even the default delay would spin for 50 ms with
+ * interrupts off.
+ */
+struct hook_call {
+    enum hook_target_id target;
+    bool fill;
+    u64 start_ns;
+};
+
+static bool notrace hook_begin(struct hook_call *call, enum hook_target_id target,
+                               bool may_sleep, bool can_fill)
+{
+    atomic_inc(&hook_active);
+    this_cpu_inc(hook_stats[target].calls);
+
+    if (in_task())
+        rng_delay_apply(may_sleep);
+
+    call->target = target;
+    call->fill = can_fill && READ_ONCE(hook_mode) == HOOK_FASTFILL;
+    call->start_ns = ktime_get_ns();
+    return call->fill;
+}
+
+static void notrace hook_end(const struct hook_call *call, ssize_t ret)
+{
+    enum hook_target_id t = call->target;
+
+    if (call->fill) {
+        this_cpu_inc(hook_stats[t].fastfill_calls);
+    } else {
+        this_cpu_inc(hook_stats[t].passthrough_calls);
+        this_cpu_add(hook_stats[t].passthrough_ns, ktime_get_ns() - call->start_ns);
+    }
+    if (ret < 0)
+        this_cpu_inc(hook_stats[t].errors);
+    else
+        this_cpu_add(hook_stats[t].bytes, ret);
+
+    atomic_dec(&hook_active);
+}
+
+/*
+ * The replacements. Calling the original re-enters the ftrace callback,
+ * which sees this module as the caller and lets the call through.
+ */
+static void notrace my_get_random_bytes(void *buf, size_t len)
+{
+    void (*real)(void *, size_t) = (void *)hook_targets[TARGET_GET_RANDOM_BYTES].addr;
+    struct hook_call call;
+
+    // Any context, including interrupts: never sleep, never fast-fill, and
+    // no delay outside task context (see hook_begin)
+    hook_begin(&call, TARGET_GET_RANDOM_BYTES, false, false);
+    real(buf, len);
+    hook_end(&call, len);
+}
+
+static ssize_t notrace my_get_random_bytes_user(struct iov_iter *iter)
+{
+    ssize_t (*real)(struct iov_iter *) = (void *)hook_targets[TARGET_GET_RANDOM_BYTES_USER].addr;
+    struct hook_call call;
+    ssize_t ret;
+
+    if (hook_begin(&call, TARGET_GET_RANDOM_BYTES_USER, true, true))
+        ret = fast_fill(iter);
+    else
+        ret = real(iter);
+    hook_end(&call, ret);
+    return ret;
+}
+
+static ssize_t notrace my_urandom_read_iter(struct kiocb *kiocb, struct iov_iter *iter)
+{
+    ssize_t (*real)(struct kiocb *, struct iov_iter *) = (void *)hook_targets[TARGET_URANDOM_READ_ITER].addr;
+    struct hook_call call;
+    ssize_t ret;
+
+    if (hook_begin(&call, TARGET_URANDOM_READ_ITER, true, true))
+        ret = fast_fill(iter);
+    else
+        ret = real(kiocb, iter);
+    hook_end(&call, ret);
+    return ret;
+}
+
+static ssize_t notrace my_random_read_iter(struct kiocb *kiocb, struct iov_iter *iter)
+{
+    ssize_t (*real)(struct kiocb *, struct iov_iter *) = (void *)hook_targets[TARGET_RANDOM_READ_ITER].addr;
+    struct hook_call call;
+    ssize_t ret;
+
+    // Fast-fill skips the real function's wait for crng readiness
+    if (hook_begin(&call, TARGET_RANDOM_READ_ITER, true, true))
+        ret = fast_fill(iter);
+    else
+        ret = real(kiocb, iter);
+    hook_end(&call, ret);
+    return ret;
+}
+
+/*
+ * The x86_64 syscall wrapper takes the user registers; the flag checks and
+ * the iov_iter setup are left to the real syscall, so it always passes
+ * through (with get_random_bytes_user hooked too, that call may fast-fill).
+ */
+static long notrace my_sys_getrandom(const struct pt_regs *regs)
+{
+    long (*real)(const struct pt_regs *) = (void *)hook_targets[TARGET_SYS_GETRANDOM].addr;
+    struct hook_call call;
+    long ret;
+
+    hook_begin(&call, TARGET_SYS_GETRANDOM, true, false);
+    ret = real(regs);
+    hook_end(&call, ret);
+    return ret;
+}
+
+static struct hook_target hook_targets[NR_TARGETS] = {
+    [TARGET_GET_RANDOM_BYTES]      = { "get_random_bytes", my_get_random_bytes },
+    [TARGET_GET_RANDOM_BYTES_USER] = { "get_random_bytes_user", my_get_random_bytes_user },
+    [TARGET_URANDOM_READ_ITER]     = { "urandom_read_iter", my_urandom_read_iter },
+    [TARGET_RANDOM_READ_ITER]      = { "random_read_iter", my_random_read_iter },
+    [TARGET_SYS_GETRANDOM]         = { "__x64_sys_getrandom", my_sys_getrandom },
+};
+
+/*
+ * Ftrace callback function that gets executed when a hooked function is called.
  * This is where we intercept the call and redirect it to our implementation.
+ * A call coming from inside this module is a replacement calling the real
+ * function and is left alone; that parent-IP check is what keeps the
+ * pass-through from being hooked again.
  */
 static void notrace ftrace_thunk(unsigned long ip, unsigned long parent_ip,
                                  struct ftrace_ops *ops, struct ftrace_regs *fregs)
 {
     // Get the pt_regs structure containing register values
     struct pt_regs *regs = ftrace_get_regs(fregs);
+    int i;
 
-    // Extract function arguments from registers (x86_64 calling convention)
-    void *buf = (void *)regs->di;    // First argument (RDI)
-    int nbytes = (int)regs->si;       // Second argument (RSI)
+    if (within_module(parent_ip, THIS_MODULE))
+        return;
 
-    // Call our custom implementation
-    my_get_random_bytes(buf, nbytes);
+    for (i = 0; i < NR_TARGETS; i++) {
+        unsigned long addr = hook_targets[i].addr;
+
+        if (addr && ip >= addr && ip - addr < HOOK_IP_RANGE) {
+            // Resume in our replacement instead of the original function
+            regs->ip = (unsigned long)hook_targets[i].replacement;
+            return;
+        }
+    }
 }
 
 /*
@@ -89,7 +403,7 @@ static unsigned long get_symbol_address(const char *name)
  * Ftrace operations structure that defines our hook.
  * The flags configure how ftrace will handle our hook:
  * - SAVE_REGS: Save register state
- * - RECURSION: Allow recursion
+ * - RECURSION: Have ftrace guard the callback against recursion
  * - IPMODIFY: Allow modifying the instruction pointer
  */
 static struct ftrace_ops hook_ops = {
@@ -97,42 +411,163 @@ static struct ftrace_ops hook_ops = {
     .flags = FTRACE_OPS_FL_SAVE_REGS | FTRACE_OPS_FL_RECURSION | FTRACE_OPS_FL_IPMODIFY,
 };
 
+/*
+ * Adds (remove = 0) or removes every resolved target to the one filter of
+ * hook_ops; a single update on kernels that take a list of addresses.
+ */
+static int set_target_filter(int remove)
+{
+    unsigned long ips[NR_TARGETS];
+    unsigned int count = 0;
+    int i;
+
+    for (i = 0; i < NR_TARGETS; i++) {
+        if (hook_targets[i].addr)
+            ips[count++] = hook_targets[i].addr;
+    }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+    return ftrace_set_filter_ips(&hook_ops, ips, count, remove, 0);
+#else
+    for (i = 0; i < count; i++) {
+        int ret = ftrace_set_filter_ip(&hook_ops, ips[i], remove, 0);
+
+        if (ret && !remove) {
+            while (--i >= 0)
+                ftrace_set_filter_ip(&hook_ops, ips[i], 1, 0);
+            return ret;
+        }
+    }
+    return 0;
+#endif
+}
+
+/*
+ * Resolves every target named in targets=; unknown names are an error,
+ * symbols missing from this kernel (inlined or renamed) are skipped.
+ */
+static int resolve_targets(void)
+{
+    char *list, *cursor, *name;
+    int hooked = 0, ret = 0, i;
+
+    list = kstrdup(targets, GFP_KERNEL);
+    if (!list)
+        return -ENOMEM;
+
+    cursor = list;
+    while ((name = strsep(&cursor, ",")) != NULL) {
+        bool all = strcmp(name, "all") == 0;
+        bool found = all;
+
+        if (!*name)
+            continue;
+        for (i = 0; i < NR_TARGETS; i++) {
+            struct hook_target *t = &hook_targets[i];
+
+            if (!all && strcmp(name, t->name) != 0)
+                continue;
+            found = true;
+            if (t->addr)
+                continue;
+            t->addr = get_symbol_address(t->name);
+            if (t->addr)
+                hooked++;
+            else
+                pr_warn("Unable to find symbol: %s, not hooked\n", t->name);
+        }
+        if (!found) {
+            pr_err("Unknown hook target: %s\n", name);
+            ret = -EINVAL;
+            break;
+        }
+    }
+    kfree(list);
+
+    if (!ret && !hooked)
+        ret = -ENOENT;
+    return ret;
+}
+
+/*
+ * debugfs ftrace_hook_demo/stats: counters of every hooked target, summed
+ * over the CPUs
+ */
+static int stats_show(struct seq_file *m, void *v)
+{
+    int cpu, i;
+
+    seq_printf(m, "mode %s seed %llu\n", hook_mode_names[READ_ONCE(hook_mode)], READ_ONCE(fill_seed));
+    seq_printf(m, "%-22s %12s %12s %16s %12s %16s %8s\n", "target", "calls", "passthrough",
+               "passthrough_ns", "fastfill", "bytes", "errors");
+    for (i = 0; i < NR_TARGETS; i++) {
+        struct hook_cpu_stats total = {};
+
+        if (!hook_targets[i].addr)
+            continue;
+        for_each_possible_cpu(cpu) {
+            const struct hook_cpu_stats *s = per_cpu_ptr(&hook_stats[i], cpu);
+
+            total.calls += s->calls;
+            total.passthrough_calls += s->passthrough_calls;
+            total.passthrough_ns += s->passthrough_ns;
+            total.fastfill_calls += s->fastfill_calls;
+            total.bytes += s->bytes;
+            total.errors += s->errors;
+        }
+        seq_printf(m, "%-22s %12llu %12llu %16llu %12llu %16llu %8llu\n", hook_targets[i].name,
+                   total.calls, total.passthrough_calls, total.passthrough_ns, total.fastfill_calls,
+                   total.bytes, total.errors);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
 /*
  * Module initialization function.
- * Sets up the ftrace hook for get_random_bytes.
+ * Resolves the targets and hooks all of them with one ftrace_ops.
  */
 static int __init ftrace_hook_init(void)
 {
-    // Find address of get_random_bytes using our symbol lookup
-    unsigned long addr = get_symbol_address("get_random_bytes_user");
-    if (!addr) {
-        pr_err("Unable to find symbol: get_random_bytes_user\n");
-        return -ENOENT;
-    }
+    int ret, i;
 
-    // Save the original function pointer
-    real_get_random_bytes = (void *)addr;
+    rng_delay_init();
 
-    // Set up ftrace filter to only trigger on our target function
-    int ret = ftrace_set_filter_ip(&hook_ops, addr, 0, 0);
+    ret = resolve_targets();
+    if (ret)
+        goto clear_targets;
+
+    // Set up ftrace filter to only trigger on our target functions
+    ret = set_target_filter(0);
     if (ret) {
         pr_err("ftrace_set_filter_ip failed: %d\n", ret);
-        return ret;
+        goto clear_targets;
     }
 
+    debug_dir = debugfs_create_dir("ftrace_hook_demo", NULL);
+    debugfs_create_file("stats", 0444, debug_dir, NULL, &stats_fops);
+
     // Register our ftrace hook
     ret = register_ftrace_function(&hook_ops);
     if (ret) {
         pr_err("register_ftrace_function failed: %d\n", ret);
         // Clean up filter if registration failed
-        ftrace_set_filter_ip(&hook_ops, addr, 1, 0);
-        return ret;
+        set_target_filter(1);
+        debugfs_remove_recursive(debug_dir);
+        goto clear_targets;
     }
 
-
-
-    pr_info("ftrace_hook_demo loaded and hooked get_random_bytes_user()\n");
+    for (i = 0; i < NR_TARGETS; i++) {
+        if (hook_targets[i].addr)
+            pr_info("ftrace_hook_demo hooked %s() in %s mode\n", hook_targets[i].name,
+                    hook_mode_names[hook_mode]);
+    }
     return 0;
+
+clear_targets:
+    for (i = 0; i < NR_TARGETS; i++)
+        hook_targets[i].addr = 0;
+    return ret;
 }
 
 /*
@@ -141,15 +576,31 @@ static int __init ftrace_hook_init(void)
  */
 static void __exit ftrace_hook_exit(void)
 {
-    if (real_get_random_bytes) {
-        // Remove the ftrace filter
-        ftrace_set_filter_ip(&hook_ops, (unsigned long)real_get_random_bytes, 1, 0);
+    // Unregister our hook
+    unregister_ftrace_function(&hook_ops);
 
-        // Unregister our hook
-        unregister_ftrace_function(&hook_ops);
+    // Remove the ftrace filter
+    set_target_filter(1);
 
-        pr_info("ftrace_hook_demo unloaded and unhooked get_random_bytes()\n");
-    }
+    /*
+     * Three steps before the text can go. hook_active only covers a call
+     * between hook_begin()'s increment and hook_end()'s decrement; it does
+     * not cover the instructions just before and just after those points.
+     * A task redirected to a replacement that has not yet reached
+     * hook_begin() cannot sleep on the way there. The first RCU-tasks grace
+     * period therefore waits until every such task has incremented
+     * hook_active or left the module. The counter then covers calls that
+     * sleep inside a replacement, where RCU-tasks would already count a
+     * task as quiescent. The second grace period covers the instructions
+     * after the decrement up to the return.
+     */
+    synchronize_rcu_tasks();
+    while (atomic_read(&hook_active))
+        msleep(10);
+    synchronize_rcu_tasks();
+
+    debugfs_remove_recursive(debug_dir);
+    pr_info("ftrace_hook_demo unloaded and unhooked the RNG entry points\n");
 }
 
 // Standard module entry and exit points
@@ -3,71 +3,375 @@
 #include <linux/kprobes.h>
 #include <linux/string.h>
 #include <linux/delay.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/uio.h>
+#include <linux/sched.h>
+#include <linux/timekeeping.h>
+#include <linux/mutex.h>
+#include <linux/atomic.h>
+#include "rng_delay.h"
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("kapusha");
 MODULE_DESCRIPTION("Safe kprobe-only override of get_random_bytes");
 
 /*
- * Kprobe structure that will store our hook information.
- * This is static since we only need one instance.
+ * Event ring is off by default: counters and histograms are enough for most
+ * runs and cost a few per-CPU increments per call.
+ */
+static bool event_ring;
+module_param(event_ring, bool, 0444);
+MODULE_PARM_DESC(event_ring, "Record every call in a per-CPU event ring (debugfs kprobe_demo/events)");
+
+/*
+ * Latency histogram bucket i counts calls that took [2^(i-1), 2^i) ns;
+ * bucket 0 is for 0 ns.
  */
-static struct kprobe kp;
+#define HIST_BUCKETS 64
 
 /*
- * Pre-handler function that executes before the probed function.
- * This gives us a chance to inspect/modify parameters and registers.
+ * Per-CPU statistics. Kprobe handlers run with preemption disabled and
+ * kprobes do not nest, so each CPU's copy has a single writer and plain
+ * this_cpu operations are enough.
  */
-static int handler_pre(struct kprobe *p, struct pt_regs *regs)
+struct rng_cpu_stats {
+    unsigned int epoch;     // stats_epoch this copy was last cleared for
+    u64 calls;
+    u64 bytes_requested;
+    u64 bytes_returned;
+    u64 errors;
+    u64 hist[HIST_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct rng_cpu_stats, rng_stats);
+
+/*
+ * Resets keep the single-writer rule: a write to debugfs reset only bumps
+ * stats_epoch, and each CPU clears its own copy in its next handler once it
+ * sees the copy is from an older epoch. Clearing another CPU's copy from
+ * the reset path would race with that CPU's handlers and could leave torn
+ * counters. Readers skip copies from older epochs. A call in flight across
+ * a reset may still be counted on one side only.
+ */
+static atomic_t stats_epoch = ATOMIC_INIT(0);
+
+static void stats_sync_epoch(void)
 {
-    // Extract function arguments from registers (x86_64 calling convention)
-    void *buf = (void *)regs->di;    // First argument (destination buffer)
-    int len = (int)regs->si;         // Second argument (buffer length)
+    struct rng_cpu_stats *s = this_cpu_ptr(&rng_stats);
+    unsigned int epoch = atomic_read(&stats_epoch);
 
-    pr_info("[kprobe] get_random_bytes intercepted — overwriting %d bytes\n", len);
+    if (unlikely(s->epoch != epoch)) {
+        memset(s, 0, sizeof(*s));
+        WRITE_ONCE(s->epoch, epoch);
+    }
+}
 
-    /*
-     * Creating a delay
-     */
-    mdelay(50);
+/*
+ * One record per call in the optional ring. The layout is what a reader of
+ * debugfs kprobe_demo/events gets, back to back, in native byte order.
+ */
+struct rng_event {
+    u64 timestamp_ns;   // ktime_get_ns() at entry
+    u64 latency_ns;     // entry to return
+    u64 size;           // bytes requested
+    u32 pid;
+    u32 cpu;
+};
+
+#define RING_ENTRIES 4096   // per CPU, power of two
+
+/*
+ * Single-producer overwrite ring. The producer fills the slot and then
+ * publishes it by advancing head with release semantics; the reader
+ * re-checks head after copying and drops any slot that may have been
+ * overwritten meanwhile, so neither side ever takes a lock.
+ */
+struct rng_ring {
+    u64 head;           // total events written
+    u64 tail;           // next event the reader has not consumed
+    struct rng_event *events;
+};
+
+static DEFINE_PER_CPU(struct rng_ring, rng_rings);
+static DEFINE_MUTEX(events_lock);  // one consuming reader at a time
+
+/*
+ * Data carried from entry to return for each call in flight
+ */
+struct call_data {
+    u64 start_ns;
+    u64 size;
+};
+
+static struct dentry *debug_dir;
+
+static unsigned int latency_bucket(u64 ns)
+{
+    unsigned int bucket = fls64(ns);
+    return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+static void record_event(u64 start_ns, u64 latency_ns, u64 size)
+{
+    struct rng_ring *ring = this_cpu_ptr(&rng_rings);
+    struct rng_event *e;
+    u64 head;
+
+    if (!ring->events)
+        return;
+
+    head = ring->head;
+    e = &ring->events[head & (RING_ENTRIES - 1)];
+    e->timestamp_ns = start_ns;
+    e->latency_ns = latency_ns;
+    e->size = size;
+    e->pid = task_pid_nr(current);
+    e->cpu = smp_processor_id();
+    smp_store_release(&ring->head, head + 1);
+}
+
+/*
+ * Entry handler, runs before get_random_bytes_user(struct iov_iter *).
+ * Counts the call and remembers when and how much was asked for.
+ */
+static int entry_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct call_data *data = (struct call_data *)ri->data;
+    struct iov_iter *iter = (struct iov_iter *)regs->di;  // First argument (x86_64)
+
+    data->size = iov_iter_count(iter);
+
+    stats_sync_epoch();
+    this_cpu_inc(rng_stats.calls);
+    this_cpu_add(rng_stats.bytes_requested, data->size);
 
     /*
-     * Return 0 to continue execution (let the original function run after us)
-     * This is safer than skipping execution entirely, as some callers might
-     * rely on side effects of the original function.
+     * Creating a delay; kprobe handlers run with preemption disabled, so
+     * this always spins
      */
+    rng_delay_apply(false);
+
+    // Taken after the delay, so the histogram shows the real function only
+    data->start_ns = ktime_get_ns();
+    return 0;
+}
+
+/*
+ * Return handler: the return value is the number of bytes copied or a
+ * negative error.
+ */
+static int return_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct call_data *data = (struct call_data *)ri->data;
+    long ret = (long)regs_return_value(regs);
+    u64 latency = ktime_get_ns() - data->start_ns;
+
+    // May run on another CPU than the entry handler did
+    stats_sync_epoch();
+    if (ret < 0)
+        this_cpu_inc(rng_stats.errors);
+    else
+        this_cpu_add(rng_stats.bytes_returned, ret);
+    this_cpu_inc(rng_stats.hist[latency_bucket(latency)]);
+
+    if (event_ring)
+        record_event(data->start_ns, latency, data->size);
+    return 0;
+}
+
+/*
+ * Kretprobe structure that will store our hook information.
+ * This is static since we only need one instance.
+ */
+static struct kretprobe krp = {
+    .kp.symbol_name = "get_random_bytes_user",
+    .entry_handler = entry_handler,
+    .handler = return_handler,
+    .data_size = sizeof(struct call_data),
+    .maxactive = 64,    // calls that may be in flight (sleeping) at once
+};
+
+/*
+ * debugfs kprobe_demo/stats: totals, per-CPU counters and the summed
+ * histogram as text
+ */
+static int stats_show(struct seq_file *m, void *v)
+{
+    struct rng_cpu_stats total = {};
+    unsigned int epoch = atomic_read(&stats_epoch);
+    int cpu, i;
+
+    seq_printf(m, "%-6s %14s %16s %16s %10s\n", "cpu", "calls", "bytes_requested", "bytes_returned", "errors");
+    for_each_possible_cpu(cpu) {
+        const struct rng_cpu_stats *s = per_cpu_ptr(&rng_stats, cpu);
+
+        if (READ_ONCE(s->epoch) != epoch)
+            continue;   // not cleared since the last reset: counts as zero
+        total.calls += s->calls;
+        total.bytes_requested += s->bytes_requested;
+        total.bytes_returned += s->bytes_returned;
+        total.errors += s->errors;
+        for (i = 0; i < HIST_BUCKETS; i++)
+            total.hist[i] += s->hist[i];
+
+        if (s->calls)
+            seq_printf(m, "%-6d %14llu %16llu %16llu %10llu\n", cpu, s->calls,
+                       s->bytes_requested, s->bytes_returned, s->errors);
+    }
+    seq_printf(m, "%-6s %14llu %16llu %16llu %10llu\n", "total", total.calls,
+               total.bytes_requested, total.bytes_returned, total.errors);
+    seq_printf(m, "missed %lu\n", (unsigned long)krp.nmissed + krp.kp.nmissed);
+
+    seq_puts(m, "latency_ns_upper count\n");
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        if (total.hist[i])
+            seq_printf(m, "%llu %llu\n", i ? (1ULL << i) - 1 : 0ULL, total.hist[i]);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
+/*
+ * debugfs kprobe_demo/reset: any write clears counters and histograms, as
+ * each CPU next runs a handler (see stats_epoch)
+ */
+static ssize_t reset_write(struct file *file, const char __user *buf, size_t len, loff_t *ppos)
+{
+    atomic_inc(&stats_epoch);
+    return len;
+}
+
+static const struct file_operations reset_fops = {
+    .owner = THIS_MODULE,
+    .write = reset_write,
+};
+
+/*
+ * debugfs kprobe_demo/events: consuming read of struct rng_event records.
+ * Each read returns whole records not seen before, CPU by CPU; events
+ * overwritten before they were read are skipped.
+ */
+static ssize_t events_read(struct file *file, char __user *buf, size_t len, loff_t *ppos)
+{
+    size_t copied = 0;
+    int cpu;
+
+    if (len < sizeof(struct rng_event))
+        return -EINVAL;
+
+    mutex_lock(&events_lock);
+    for_each_possible_cpu(cpu) {
+        struct rng_ring *ring = per_cpu_ptr(&rng_rings, cpu);
+        u64 head = smp_load_acquire(&ring->head);
+
+        if (!ring->events)
+            continue;
+        if (head - ring->tail > RING_ENTRIES)
+            ring->tail = head - RING_ENTRIES;
+
+        while (ring->tail < head && copied + sizeof(struct rng_event) <= len) {
+            struct rng_event e = ring->events[ring->tail & (RING_ENTRIES - 1)];
+
+            // The producer rewrites this slot when head reaches tail + RING_ENTRIES
+            smp_rmb();
+            if (READ_ONCE(ring->head) >= ring->tail + RING_ENTRIES) {
+                ring->tail++;
+                continue;
+            }
+            if (copy_to_user(buf + copied, &e, sizeof(e))) {
+                mutex_unlock(&events_lock);
+                return copied ? copied : -EFAULT;
+            }
+            copied += sizeof(e);
+            ring->tail++;
+        }
+    }
+    mutex_unlock(&events_lock);
+    return copied;
+}
+
+static const struct file_operations events_fops = {
+    .owner = THIS_MODULE,
+    .read = events_read,
+    .llseek = noop_llseek,
+};
+
+static void free_rings(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct rng_ring *ring = per_cpu_ptr(&rng_rings, cpu);
+
+        vfree(ring->events);
+        ring->events = NULL;
+    }
+}
+
+static int alloc_rings(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct rng_ring *ring = per_cpu_ptr(&rng_rings, cpu);
+
+        ring->events = vzalloc_node(RING_ENTRIES * sizeof(struct rng_event), cpu_to_node(cpu));
+        if (!ring->events) {
+            free_rings();
+            return -ENOMEM;
+        }
+    }
     return 0;
 }
 
 /*
  * Module initialization function.
- * Sets up the kprobe on get_random_bytes.
+ * Sets up the kretprobe on get_random_bytes_user and the debugfs files.
  */
 static int __init kprobe_init(void)
 {
-    // Configure our kprobe
-    kp.symbol_name = "get_random_bytes_user";  // Function we want to probe
-    kp.pre_handler = handler_pre;         // Our pre-execution callback
+    int ret;
+
+    rng_delay_init();
+
+    if (event_ring) {
+        ret = alloc_rings();
+        if (ret)
+            return ret;
+    }
+
+    debug_dir = debugfs_create_dir("kprobe_demo", NULL);
+    debugfs_create_file("stats", 0444, debug_dir, NULL, &stats_fops);
+    debugfs_create_file("reset", 0200, debug_dir, NULL, &reset_fops);
+    if (event_ring)
+        debugfs_create_file("events", 0400, debug_dir, NULL, &events_fops);
 
-    // Register the kprobe
-    int ret = register_kprobe(&kp);
+    // Register the kretprobe
+    ret = register_kretprobe(&krp);
     if (ret < 0) {
-        pr_err("Failed to register kprobe: %d\n", ret);
+        pr_err("Failed to register kretprobe: %d\n", ret);
+        debugfs_remove_recursive(debug_dir);
+        free_rings();
         return ret;
     }
 
-    pr_info("kprobe registered for %s\n", kp.symbol_name);
+    pr_info("kretprobe registered for %s%s\n", krp.kp.symbol_name, event_ring ? " with event ring" : "");
     return 0;
 }
 
 /*
  * Module cleanup function.
- * Removes our kprobe when module is unloaded.
+ * Removes our kretprobe when module is unloaded.
  */
 static void __exit kprobe_exit(void)
 {
-    // Unregister the kprobe
-    unregister_kprobe(&kp);
-    pr_info("kprobe unregistered\n");
+    // Unregister first so no handler can touch the rings while they are freed
+    unregister_kretprobe(&krp);
+    debugfs_remove_recursive(debug_dir);
+    free_rings();
+    pr_info("kretprobe unregistered\n");
 }
 
 // Standard module entry and exit points